@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK (1 << 16)
+
+struct ArenaBlock {
+  struct ArenaBlock *next;
+  _Alignas(16) char data[];
+};
+
+struct Arena global_arena;
+_Thread_local struct Arena ast_arena;
+
+void *arena_alloc(struct Arena *arena, long size) {
+  // keep every allocation 16 byte aligned
+  size = (size + 15) & ~15L;
+
+  if (arena->end - arena->ptr < size) {
+    long block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+    struct ArenaBlock *block = malloc(sizeof(*block) + block_size);
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->ptr = block->data;
+    arena->end = block->data + block_size;
+  }
+
+  void *p = arena->ptr;
+  arena->ptr += size;
+  return p;
+}
+
+void *arena_calloc(struct Arena *arena, long size) {
+  return memset(arena_alloc(arena, size), 0, size);
+}
+
+void *arena_copy(struct Arena *arena, void *data, long size) {
+  if (size == 0) {
+    return NULL;
+  }
+
+  return memcpy(arena_alloc(arena, size), data, size);
+}
+
+void arena_reset(struct Arena *arena) {
+  if (arena->blocks == NULL) {
+    return;
+  }
+
+  // the oldest block is at the end of the list
+  while (arena->blocks->next) {
+    struct ArenaBlock *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+
+  // it may be an oversized block, but it is at least ARENA_BLOCK
+  arena->ptr = arena->blocks->data;
+  arena->end = arena->blocks->data + ARENA_BLOCK;
+}
+
+void arena_free(struct Arena *arena) {
+  arena_reset(arena);
+  free(arena->blocks);
+  *arena = (struct Arena){0};
+}
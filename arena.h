@@ -0,0 +1,34 @@
+#ifndef ARENA_HEADER
+#define ARENA_HEADER
+
+// bump pointer allocator
+// everything allocated from an arena is freed at once by arena_reset
+struct Arena {
+  struct ArenaBlock *blocks; // most recent first
+  char *ptr;
+  char *end;
+};
+
+void *arena_alloc(struct Arena *arena, long size);
+
+// same as arena_alloc but zeroed
+void *arena_calloc(struct Arena *arena, long size);
+
+// copy of data in the arena, NULL if size is 0
+// used to freeze lists that were built in a growing buffer
+void *arena_copy(struct Arena *arena, void *data, long size);
+
+// free everything, the first block is kept for reuse
+void arena_reset(struct Arena *arena);
+
+// free everything including the first block
+void arena_free(struct Arena *arena);
+
+// regions that live for the whole compile
+// global_arena holds file scope symbols and the types and structs they use
+// ast_arena holds function bodies and the locals and types they point at,
+// there is one per thread parsing bodies
+extern struct Arena global_arena;
+extern _Thread_local struct Arena ast_arena;
+
+#endif
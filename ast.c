@@ -1,26 +1,51 @@
 #include <stdio.h>
 
 #include "ast.h"
+#include "fail.h"
+#include "intern.h"
 
+// same levels as the parser, with ?: at 3
 int op_precedences[256] = {
-    [O_MUL] = 6, [O_DIV] = 6, [O_MOD] = 6,              // multiplicative ops
-    [O_ADD] = 5, [O_SUB] = 5,                           // additive ops
-    [O_LT] = 4,  [O_GT] = 4,  [O_LTE] = 4, [O_GTE] = 4, // comparisons
-    [O_EQ] = 3,  [O_NE] = 3,                            // == !=
-    [O_AND] = 2, [O_OR] = 1,                            // logic
+    // arithmetic
+    [O_MUL] = 13, [O_DIV] = 13, [O_MOD] = 13,
+    [O_ADD] = 12, [O_SUB] = 12,
+    [O_SHL] = 11, [O_SHR] = 11,
+
+    // comparisons
+    [O_LT] = 10, [O_GT] = 10, [O_LTE] = 10, [O_GTE] = 10,
+    [O_EQ] = 9, [O_NE] = 9,
+
+    // bitwise and logic
+    [O_BIT_AND] = 8, [O_BIT_XOR] = 7, [O_BIT_OR] = 6,
+    [O_AND] = 5, [O_OR] = 4,
+
+    // assignment
+    [O_ASSIGN] = 2, [O_MUL_ASSIGN] = 2, [O_DIV_ASSIGN] = 2,
+    [O_MOD_ASSIGN] = 2, [O_ADD_ASSIGN] = 2, [O_SUB_ASSIGN] = 2,
+    [O_SHL_ASSIGN] = 2, [O_SHR_ASSIGN] = 2, [O_AND_ASSIGN] = 2,
+    [O_XOR_ASSIGN] = 2, [O_OR_ASSIGN] = 2,
+
+    [O_COMMA] = 1,
 };
 
 char *repr[256] = {
-    [O_MUL] = "*",  [O_DIV] = "/",    [O_MOD] = "%", [O_ADD] = "+",
-    [O_SUB] = "-",  [O_LT] = "<",     [O_GT] = ">",  [O_LTE] = "<=",
-    [O_GTE] = ">=", [O_EQ] = "==",    [O_NE] = "!=", [O_AND] = "&&",
-    [O_OR] = "||",  [O_ASSIGN] = "=",
+    [O_MUL] = "*",          [O_DIV] = "/",          [O_MOD] = "%",
+    [O_ADD] = "+",          [O_SUB] = "-",          [O_LT] = "<",
+    [O_GT] = ">",           [O_LTE] = "<=",         [O_GTE] = ">=",
+    [O_EQ] = "==",          [O_NE] = "!=",          [O_AND] = "&&",
+    [O_OR] = "||",          [O_ASSIGN] = "=",       [O_SHL] = "<<",
+    [O_SHR] = ">>",         [O_BIT_AND] = "&",      [O_BIT_XOR] = "^",
+    [O_BIT_OR] = "|",       [O_MUL_ASSIGN] = "*=",  [O_DIV_ASSIGN] = "/=",
+    [O_MOD_ASSIGN] = "%=",  [O_ADD_ASSIGN] = "+=",  [O_SUB_ASSIGN] = "-=",
+    [O_SHL_ASSIGN] = "<<=", [O_SHR_ASSIGN] = ">>=", [O_AND_ASSIGN] = "&=",
+    [O_XOR_ASSIGN] = "^=",  [O_OR_ASSIGN] = "|=",   [O_COMMA] = ",",
 };
 
 char *unop_repr[256] = {
-    [O_DEREF] = "*",
-    [O_REF] = "&",
-    [O_NOT] = "!",
+    [O_DEREF] = "*",    [O_REF] = "&",      [O_NOT] = "!",
+    [O_NEG] = "-",      [O_PLUS] = "+",     [O_BIT_NOT] = "~",
+    [O_PRE_INC] = "++", [O_PRE_DEC] = "--", [O_POST_INC] = "++",
+    [O_POST_DEC] = "--",
 };
 
 void debug_const(struct Constant *cnst) {
@@ -43,22 +68,35 @@ void debug_expr_inner(struct Expr *expr, int min_precedence) {
     debug_const(&expr->cnst);
     break;
   case E_VAR:
-    printf("%s", expr->var->name);
+    printf("%s", intern_str(expr->var->name));
     break;
   case E_GLOBAL:
-    printf("%s", expr->global->name);
+    printf("%s", intern_str(expr->global->name));
     break;
   case E_FUNC:
-    printf("%s", expr->func->name);
+    printf("%s", intern_str(expr->func->name));
     break;
   case E_UNOP:
-    debug_expr_inner(expr->unop.expr, min_precedence);
+    if (expr->unop.op == O_POST_INC || expr->unop.op == O_POST_DEC) {
+      debug_expr_inner(expr->unop.expr, 100);
+      printf("%s", unop_repr[expr->unop.op]);
+    } else {
+      printf("%s", unop_repr[expr->unop.op]);
+      debug_expr_inner(expr->unop.expr, 100);
+    }
     break;
   case E_BINOP:
-    if (expr->binop.op == O_ASSIGN) {
+    if (op_precedences[expr->binop.op] == 2) {
+      // assignments
+      if (min_precedence > 2)
+        printf("(");
+
       debug_expr_inner(expr->binop.l, 100);
-      printf(" = ");
-      debug_expr_inner(expr->binop.r, 0);
+      printf(" %s ", repr[expr->binop.op]);
+      debug_expr_inner(expr->binop.r, 2);
+
+      if (min_precedence > 2)
+        printf(")");
       break;
     } else if (expr->binop.op == O_INDEX) {
       debug_expr_inner(expr->binop.l, 100);
@@ -72,7 +110,7 @@ void debug_expr_inner(struct Expr *expr, int min_precedence) {
       printf("(");
 
     debug_expr_inner(expr->binop.l, op_precedences[expr->binop.op]);
-    printf(" %s ", repr[expr->binop.op]);
+    printf(expr->binop.op == O_COMMA ? "%s " : " %s ", repr[expr->binop.op]);
     debug_expr_inner(expr->binop.r, op_precedences[expr->binop.op] + 1);
 
     if (op_precedences[expr->binop.op] < min_precedence)
@@ -81,23 +119,186 @@ void debug_expr_inner(struct Expr *expr, int min_precedence) {
   case E_CALL:
     debug_expr(expr->call.func_expr);
 
-    struct Args *args = expr->call.args;
-
     printf("(");
-    while (args) {
-      debug_expr(args->expr);
-      args = args->next;
-
-      if (args) {
+    for (int i = 0; i < expr->call.n_args; i++) {
+      if (i) {
         printf(", ");
       }
+
+      // above the comma operator
+      debug_expr_inner(expr->call.args[i], 2);
     }
     printf(")");
 
     break;
+  case E_MEMBER:
+    debug_expr_inner(expr->member.expr, 100);
+    printf("%s%s", expr->member.arrow ? "->" : ".",
+           intern_str(expr->member.member->name));
+    break;
+  case E_COND:
+    if (min_precedence > 3)
+      printf("(");
+
+    debug_expr_inner(expr->cond.cond, 4);
+    printf(" ? ");
+    debug_expr_inner(expr->cond.then, 0);
+    printf(" : ");
+    debug_expr_inner(expr->cond.els, 3);
+
+    if (min_precedence > 3)
+      printf(")");
+    break;
+  case E_CAST:
+    printf("(");
+    debug_type(expr->cast.type);
+    printf(")");
+    debug_expr_inner(expr->cast.expr, 100);
+    break;
+  }
+}
+
+// type pointed to by a pointer or array, NULL for other types
+struct Type *pointee(struct Type *type) {
+  switch (type->kind) {
+  case T_POINTER:
+    return type->ptr_type;
+  case T_ARRAY:
+    return type->array.elem_type;
+  default:
+    return NULL;
   }
 }
 
+struct Type *unop_type(enum UnOp op, struct Type *type) {
+  switch (op) {
+  case O_DEREF:
+    if (pointee(type) == NULL) {
+      error_printf("Semantic error: dereferencing non-pointer type '");
+      debug_type(type);
+      error_printf("'\n");
+      FAIL;
+    }
+
+    return pointee(type);
+  case O_REF:
+    return canon_type(&(struct Type){.kind = T_POINTER, .ptr_type = type});
+  case O_NOT:
+    return canon_type(&(struct Type){.kind = T_INT});
+  case O_NEG:
+  case O_PLUS:
+  case O_BIT_NOT:
+  case O_PRE_INC:
+  case O_PRE_DEC:
+  case O_POST_INC:
+  case O_POST_DEC:
+    // TODO: integer promotions
+    return type;
+  }
+
+  FAIL;
+  return NULL;
+}
+
+struct Type *binop_type(enum BinOp op, struct Type *l, struct Type *r) {
+  switch (op) {
+  case O_ASSIGN:
+    return l;
+  case O_INDEX:
+    // a[i] is the same as i[a]
+    if (pointee(l) == NULL) {
+      l = r;
+    }
+
+    if (pointee(l) == NULL) {
+      error_printf("Semantic error: indexing non-pointer type '");
+      debug_type(l);
+      error_printf("'\n");
+      FAIL;
+    }
+
+    return pointee(l);
+  case O_ADD:
+  case O_SUB:
+  case O_MUL:
+  case O_DIV:
+  case O_MOD:
+  case O_BIT_AND:
+  case O_BIT_XOR:
+  case O_BIT_OR:
+    // pointer arithmetic keeps the pointer type
+    if (pointee(l) == NULL && pointee(r)) {
+      return r;
+    }
+
+    return l;
+  case O_SHL:
+  case O_SHR:
+  case O_MUL_ASSIGN:
+  case O_DIV_ASSIGN:
+  case O_MOD_ASSIGN:
+  case O_ADD_ASSIGN:
+  case O_SUB_ASSIGN:
+  case O_SHL_ASSIGN:
+  case O_SHR_ASSIGN:
+  case O_AND_ASSIGN:
+  case O_XOR_ASSIGN:
+  case O_OR_ASSIGN:
+    return l;
+  case O_COMMA:
+    return r;
+  default:
+    // comparisons and logic
+    return canon_type(&(struct Type){.kind = T_INT});
+  }
+}
+
+struct Type *call_type(struct Type *type) {
+  if (type->kind == T_POINTER) {
+    type = type->ptr_type;
+  }
+
+  if (type->kind != T_FUNC) {
+    error_printf("Semantic error: calling non-function type '");
+    debug_type(type);
+    error_printf("'\n");
+    FAIL;
+  }
+
+  return type->func_sig->ret;
+}
+
+struct Type *expr_type(struct Expr *expr) {
+  switch (expr->kind) {
+  case E_CONST:
+    return canon_type(&(struct Type){.kind = T_INT});
+  case E_VAR:
+    return expr->var->type;
+  case E_GLOBAL:
+    return expr->global->type;
+  case E_FUNC:
+    return canon_type(
+        &(struct Type){.kind = T_FUNC, .func_sig = expr->func->sig});
+  case E_UNOP:
+    return unop_type(expr->unop.op, expr_type(expr->unop.expr));
+  case E_BINOP:
+    return binop_type(expr->binop.op, expr_type(expr->binop.l),
+                      expr_type(expr->binop.r));
+  case E_CALL:
+    return call_type(expr_type(expr->call.func_expr));
+  case E_MEMBER:
+    return expr->member.member->type;
+  case E_COND:
+    // TODO: usual arithmetic conversions between the branches
+    return expr_type(expr->cond.then);
+  case E_CAST:
+    return expr->cast.type;
+  }
+
+  FAIL;
+  return NULL;
+}
+
 int indentation = 0;
 
 void debug_expr(struct Expr *expr) { debug_expr_inner(expr, 0); }
@@ -132,13 +333,13 @@ void debug_stmt(struct Stmt *stmt) {
 
     printf("; ");
 
-    if (stmt->for_stmt.iter)
-      debug_expr(stmt->for_stmt.iter);
+    if (stmt->for_stmt.cond)
+      debug_expr(stmt->for_stmt.cond);
 
     printf("; ");
 
-    if (stmt->for_stmt.cond)
-      debug_expr(stmt->for_stmt.cond);
+    if (stmt->for_stmt.iter)
+      debug_expr(stmt->for_stmt.iter);
 
     printf(") ");
 
@@ -21,10 +21,18 @@ struct Constant {
   };
 };
 
+// starts at 1 so tables indexed by token can use 0 for no operator
 enum UnOp {
-  O_DEREF, // *
-  O_REF,   // &
-  O_NOT,   // !
+  O_DEREF = 1, // *
+  O_REF,       // &
+  O_NOT,       // !
+  O_NEG,       // -
+  O_PLUS,      // +
+  O_BIT_NOT,   // ~
+  O_PRE_INC,   // ++a
+  O_PRE_DEC,   // --a
+  O_POST_INC,  // a++
+  O_POST_DEC,  // a--
 };
 
 enum BinOp {
@@ -49,11 +57,43 @@ enum BinOp {
   // logic
   O_OR,
   O_AND,
+
+  // bitwise
+  O_SHL,
+  O_SHR,
+  O_BIT_AND,
+  O_BIT_XOR,
+  O_BIT_OR,
+
+  // compound assignment, the left must be an lvalue like for O_ASSIGN
+  O_MUL_ASSIGN,
+  O_DIV_ASSIGN,
+  O_MOD_ASSIGN,
+  O_ADD_ASSIGN,
+  O_SUB_ASSIGN,
+  O_SHL_ASSIGN,
+  O_SHR_ASSIGN,
+  O_AND_ASSIGN,
+  O_XOR_ASSIGN,
+  O_OR_ASSIGN,
+
+  O_COMMA, // a, b
 };
 
 struct Expr {
-  // TODO: struct/array initializers, constants, field of struct
-  enum { E_CONST, E_GLOBAL, E_VAR, E_FUNC, E_UNOP, E_BINOP, E_CALL } kind;
+  // TODO: struct/array initializers, constants
+  enum {
+    E_CONST,
+    E_GLOBAL,
+    E_VAR,
+    E_FUNC,
+    E_UNOP,
+    E_BINOP,
+    E_CALL,
+    E_MEMBER,
+    E_COND,
+    E_CAST
+  } kind;
 
   union {
     struct Constant cnst;
@@ -80,15 +120,29 @@ struct Expr {
     // function call
     struct {
       struct Expr *func_expr;
-      struct Args *args;
+      struct Expr **args;
+      int n_args;
     } call;
-  };
-};
 
-// arguments to function call
-struct Args {
-  struct Expr *expr;
-  struct Args *next;
+    // struct member, expr is a pointer to the struct for ->
+    struct {
+      struct Expr *expr;
+      struct Member *member;
+      int arrow;
+    } member;
+
+    // cond ? then : els
+    struct {
+      struct Expr *cond;
+      struct Expr *then;
+      struct Expr *els;
+    } cond;
+
+    struct {
+      struct Type *type; // canonical
+      struct Expr *expr;
+    } cast;
+  };
 };
 
 struct Stmt {
@@ -124,6 +178,21 @@ struct BlockStmt {
   struct BlockStmt *next;
 };
 
+// type of an expression
+// TODO: usual arithmetic conversions
+struct Type *expr_type(struct Expr *expr);
+
+// types of operators applied to operands of the given types
+// shared by every representation of the AST
+struct Type *unop_type(enum UnOp op, struct Type *type);
+struct Type *binop_type(enum BinOp op, struct Type *l, struct Type *r);
+struct Type *call_type(struct Type *func);
+
+// printed forms of operators
+extern char *repr[256];
+extern char *unop_repr[256];
+
+void debug_const(struct Constant *cnst);
 void debug_expr(struct Expr *expr);
 void debug_block_stmt(struct BlockStmt *expr);
 void debug_stmt(struct Stmt *stmt);
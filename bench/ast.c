@@ -0,0 +1,358 @@
+// AST layout benchmark
+// usage: ast [functions] [statements] [runs]
+// parses a generated file of large functions, flattens each body and
+// compares the memory used and the time taken to walk and type every node in
+// the pointer AST and in the flat AST
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../ast.h"
+#include "../flat.h"
+#include "../intern.h"
+#include "../lexer.h"
+#include "../parser.h"
+#include "../source.h"
+#include "../symbols.h"
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+char *statements[] = {
+    "x = a + b * (x - 3) / 2;",
+    "y = h(x, y + 1) + arr[x % 16];",
+    "p.x = q->y + p.y;",
+    "if (x < y) x = y - 1; else y = x + 2;",
+    "while (x > 0) x = x - 1;",
+    "q = &p; g = q->next->x == y;",
+};
+
+#define N_STATEMENTS (int)(sizeof(statements) / sizeof(*statements))
+
+FILE *generate(int n_funcs, int n_stmts) {
+  FILE *file = tmpfile();
+
+  fprintf(file, "struct P { int x; int y; struct P *next; };\n"
+                "int g;\n"
+                "int h(int a, int b);\n");
+
+  for (int f = 0; f < n_funcs; f++) {
+    fprintf(file, "int f%d(int a, int b) {\n"
+                  "  int x; int y; struct P p; struct P *q; int arr[16];\n",
+            f);
+
+    for (int s = 0; s < n_stmts; s++) {
+      fprintf(file, "  %s\n", statements[(f + s) % N_STATEMENTS]);
+    }
+
+    fprintf(file, "  return x;\n}\n");
+  }
+
+  rewind(file);
+  return file;
+}
+
+// pointer AST walks, recursive like every pass over it
+// expression kinds are counted in kinds, which share their order with the
+// flat kinds, and the size of every node is added to bytes
+
+void count_expr(struct Expr *expr, long *kinds, long *bytes) {
+  if (expr == NULL) {
+    return;
+  }
+
+  kinds[expr->kind]++;
+  *bytes += sizeof(*expr);
+
+  switch (expr->kind) {
+  case E_UNOP:
+    count_expr(expr->unop.expr, kinds, bytes);
+    break;
+  case E_BINOP:
+    count_expr(expr->binop.l, kinds, bytes);
+    count_expr(expr->binop.r, kinds, bytes);
+    break;
+  case E_CALL:
+    count_expr(expr->call.func_expr, kinds, bytes);
+    *bytes += expr->call.n_args * sizeof(*expr->call.args);
+
+    for (int i = 0; i < expr->call.n_args; i++) {
+      count_expr(expr->call.args[i], kinds, bytes);
+    }
+    break;
+  case E_MEMBER:
+    count_expr(expr->member.expr, kinds, bytes);
+    break;
+  case E_COND:
+    count_expr(expr->cond.cond, kinds, bytes);
+    count_expr(expr->cond.then, kinds, bytes);
+    count_expr(expr->cond.els, kinds, bytes);
+    break;
+  case E_CAST:
+    count_expr(expr->cast.expr, kinds, bytes);
+    break;
+  default:
+    break;
+  }
+}
+
+void count_block(struct BlockStmt *block, long *kinds, long *bytes);
+
+void count_stmt(struct Stmt *stmt, long *kinds, long *bytes) {
+  if (stmt == NULL) {
+    return;
+  }
+
+  *bytes += sizeof(*stmt);
+
+  switch (stmt->kind) {
+  case S_BLOCK:
+    count_block(stmt->block, kinds, bytes);
+    break;
+  case S_EXPR:
+  case S_RETURN:
+    count_expr(stmt->expr, kinds, bytes);
+    break;
+  case S_IF:
+    count_expr(stmt->if_stmt.cond, kinds, bytes);
+    count_stmt(stmt->if_stmt.if_block, kinds, bytes);
+    count_stmt(stmt->if_stmt.else_block, kinds, bytes);
+    break;
+  case S_WHILE:
+    count_expr(stmt->while_stmt.cond, kinds, bytes);
+    count_stmt(stmt->while_stmt.block, kinds, bytes);
+    break;
+  case S_FOR:
+    count_expr(stmt->for_stmt.init, kinds, bytes);
+    count_expr(stmt->for_stmt.cond, kinds, bytes);
+    count_expr(stmt->for_stmt.iter, kinds, bytes);
+    count_stmt(stmt->for_stmt.block, kinds, bytes);
+    break;
+  }
+}
+
+void count_block(struct BlockStmt *block, long *kinds, long *bytes) {
+  for (; block; block = block->next) {
+    *bytes += sizeof(*block);
+    count_stmt(block->stmt, kinds, bytes);
+  }
+}
+
+// type every expression bottom up, like a checking pass would
+struct Type *type_expr(struct Expr *expr, long *typed) {
+  struct Type *l, *r;
+
+  (*typed)++;
+
+  switch (expr->kind) {
+  case E_UNOP:
+    return unop_type(expr->unop.op, type_expr(expr->unop.expr, typed));
+  case E_BINOP:
+    l = type_expr(expr->binop.l, typed);
+    r = type_expr(expr->binop.r, typed);
+    return binop_type(expr->binop.op, l, r);
+  case E_CALL:
+    l = type_expr(expr->call.func_expr, typed);
+
+    for (int i = 0; i < expr->call.n_args; i++) {
+      type_expr(expr->call.args[i], typed);
+    }
+
+    return call_type(l);
+  case E_COND:
+    type_expr(expr->cond.cond, typed);
+    l = type_expr(expr->cond.then, typed);
+    type_expr(expr->cond.els, typed);
+    return l;
+  case E_CAST:
+    type_expr(expr->cast.expr, typed);
+    return expr->cast.type;
+  default:
+    // leaves and members have their type without looking further
+    if (expr->kind == E_MEMBER) {
+      type_expr(expr->member.expr, typed);
+    }
+
+    return expr_type(expr);
+  }
+}
+
+void type_block(struct BlockStmt *block, long *typed);
+
+void type_stmt(struct Stmt *stmt, long *typed) {
+  if (stmt == NULL) {
+    return;
+  }
+
+  switch (stmt->kind) {
+  case S_BLOCK:
+    type_block(stmt->block, typed);
+    break;
+  case S_EXPR:
+  case S_RETURN:
+    if (stmt->expr) {
+      type_expr(stmt->expr, typed);
+    }
+    break;
+  case S_IF:
+    type_expr(stmt->if_stmt.cond, typed);
+    type_stmt(stmt->if_stmt.if_block, typed);
+    type_stmt(stmt->if_stmt.else_block, typed);
+    break;
+  case S_WHILE:
+    type_expr(stmt->while_stmt.cond, typed);
+    type_stmt(stmt->while_stmt.block, typed);
+    break;
+  case S_FOR:
+    if (stmt->for_stmt.init) {
+      type_expr(stmt->for_stmt.init, typed);
+    }
+
+    if (stmt->for_stmt.cond) {
+      type_expr(stmt->for_stmt.cond, typed);
+    }
+
+    if (stmt->for_stmt.iter) {
+      type_expr(stmt->for_stmt.iter, typed);
+    }
+
+    type_stmt(stmt->for_stmt.block, typed);
+    break;
+  }
+}
+
+void type_block(struct BlockStmt *block, long *typed) {
+  for (; block; block = block->next) {
+    type_stmt(block->stmt, typed);
+  }
+}
+
+int main(int argc, char **argv) {
+  int n_funcs = argc > 1 ? atoi(argv[1]) : 20;
+  int n_stmts = argc > 2 ? atoi(argv[2]) : 20000;
+  int runs = argc > 3 ? atoi(argv[3]) : 10;
+
+  FILE *file = generate(n_funcs, n_stmts);
+  source = read_source(file, "bench");
+  fclose(file);
+
+  parse();
+
+  struct Func **funcs = malloc(n_funcs * sizeof(*funcs));
+  struct FlatAst **flats = malloc(n_funcs * sizeof(*flats));
+  long ptr_bytes = 0, flat_bytes = 0, nodes = 0, max_len = 0;
+
+  double start = now();
+
+  for (int f = 0; f < n_funcs; f++) {
+    char name[32];
+    int len = sprintf(name, "f%d", f);
+
+    funcs[f] = lookup_symbol(intern(name, len))->func;
+    flats[f] = flatten_func(funcs[f]);
+  }
+
+  double flatten = now() - start;
+
+  for (int f = 0; f < n_funcs; f++) {
+    struct FlatAst *flat = flats[f];
+    long kinds[N_BLOCK + 1] = {0};
+
+    count_block(funcs[f]->stmt, kinds, &ptr_bytes);
+
+    nodes += flat->len;
+    flat_bytes += flat->len * (sizeof(*flat->kinds) + sizeof(*flat->ops) +
+                               sizeof(*flat->l) + sizeof(*flat->r) +
+                               sizeof(*flat->data)) +
+                  flat->lists_len * sizeof(*flat->lists);
+
+    if (flat->len > max_len) {
+      max_len = flat->len;
+    }
+  }
+
+  struct Type **types = malloc(max_len * sizeof(*types));
+
+  printf("%d functions of %d statements, %ld nodes, flattened in %.1f ms\n",
+         n_funcs, n_stmts, nodes, flatten * 1e3);
+  printf("  memory:  pointer %6.1f MB, flat %6.1f MB\n", ptr_bytes / 1e6,
+         flat_bytes / 1e6);
+
+  double best[2][2] = {{1e9, 1e9}, {1e9, 1e9}};
+
+  for (int r = 0; r < runs; r++) {
+    long kinds[2][N_BLOCK + 1] = {{0}};
+    long typed[2] = {0};
+    long bytes = 0;
+    double times[2][2];
+
+    // count nodes by kind
+    start = now();
+
+    for (int f = 0; f < n_funcs; f++) {
+      count_block(funcs[f]->stmt, kinds[0], &bytes);
+    }
+
+    times[0][0] = now() - start;
+    start = now();
+
+    for (int f = 0; f < n_funcs; f++) {
+      struct FlatAst *flat = flats[f];
+
+      for (int i = 0; i < flat->len; i++) {
+        kinds[1][flat->kinds[i]]++;
+      }
+    }
+
+    times[0][1] = now() - start;
+
+    // type every expression
+    start = now();
+
+    for (int f = 0; f < n_funcs; f++) {
+      type_block(funcs[f]->stmt, &typed[0]);
+    }
+
+    times[1][0] = now() - start;
+    start = now();
+
+    for (int f = 0; f < n_funcs; f++) {
+      flat_types(flats[f], types);
+
+      for (int i = 0; i < flats[f]->len; i++) {
+        typed[1] += types[i] != NULL;
+      }
+    }
+
+    times[1][1] = now() - start;
+
+    for (int k = N_CONST; k <= N_CAST; k++) {
+      if (kinds[0][k] != kinds[1][k]) {
+        printf("walks disagree on kind %d: %ld %ld\n", k, kinds[0][k],
+               kinds[1][k]);
+        return 1;
+      }
+    }
+
+    if (typed[0] != typed[1]) {
+      printf("typed different expressions: %ld %ld\n", typed[0], typed[1]);
+      return 1;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      if (times[i / 2][i % 2] < best[i / 2][i % 2]) {
+        best[i / 2][i % 2] = times[i / 2][i % 2];
+      }
+    }
+  }
+
+  printf("  walk:    pointer %6.2f ns per node, flat %6.2f ns per node\n",
+         best[0][0] / nodes * 1e9, best[0][1] / nodes * 1e9);
+  printf("  types:   pointer %6.2f ns per node, flat %6.2f ns per node\n",
+         best[1][0] / nodes * 1e9, best[1][1] / nodes * 1e9);
+
+  return 0;
+}
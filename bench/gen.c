@@ -0,0 +1,133 @@
+// generator for synthetic lexer benchmark sources
+// usage: gen <mix> <size in KB> [seed]
+// mix is one of ident, op, comment, literal, or mixed for all four
+// the output only depends on the arguments so runs can be compared
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned int seed = 12345;
+
+unsigned int next_rand() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+char *keywords[] = {"int",   "char",   "unsigned", "struct", "return",
+                    "if",    "else",   "while",    "for",    "static",
+                    "const", "sizeof", "void",     "long",   "switch"};
+
+#define N_KEYWORDS (int)(sizeof(keywords) / sizeof(keywords[0]))
+
+char *operators[] = {"+",  "-",  "*",  "/",  "%",  "<<", ">>",  "<",
+                     ">",  "<=", ">=", "==", "!=", "&",  "|",   "^",
+                     "&&", "||", "=",  "+=", "-=", "<<=", "->", "."};
+
+#define N_OPERATORS (int)(sizeof(operators) / sizeof(operators[0]))
+
+// identifiers are drawn from a fixed pool so the interner sees repeats
+#define N_NAMES 4096
+char names[N_NAMES][24];
+
+void make_names() {
+  for (int i = 0; i < N_NAMES; i++) {
+    int len = 2 + next_rand() % 16;
+
+    for (int j = 0; j < len; j++) {
+      names[i][j] = "abcdefghijklmnopqrstuvwxyz_"[next_rand() % 27];
+    }
+
+    names[i][len] = '\0';
+  }
+}
+
+char *name() { return names[next_rand() % N_NAMES]; }
+
+// each of these writes one line
+int ident_line(char *out) {
+  return sprintf(out, "%s %s %s = %s(%s, %s);\n",
+                 keywords[next_rand() % N_KEYWORDS], name(), name(), name(),
+                 name(), name());
+}
+
+int op_line(char *out) {
+  int len = sprintf(out, "  %s", name());
+
+  for (int i = 0; i < 8; i++) {
+    len += sprintf(out + len, " %s %c", operators[next_rand() % N_OPERATORS],
+                   "abcxyz"[next_rand() % 6]);
+  }
+
+  return len + sprintf(out + len, ";\n");
+}
+
+int comment_line(char *out) {
+  switch (next_rand() % 3) {
+  case 0:
+    return sprintf(out, "// %s %s %s %s %s %s\n", name(), name(), name(),
+                   name(), name(), name());
+  case 1:
+    return sprintf(out, "/* %s %s\n * %s %s %s\n */\n", name(), name(), name(),
+                   name(), name());
+  default:
+    return sprintf(out, "%s(); /* %s %s */\n", name(), name(), name());
+  }
+}
+
+int literal_line(char *out) {
+  switch (next_rand() % 4) {
+  case 0:
+    return sprintf(out, "  %u, 0x%08x, %u, %u,\n", next_rand(), next_rand(),
+                   next_rand() % 100, next_rand());
+  case 1:
+    return sprintf(out, "  %.6f, %.3e,\n", next_rand() / 1000.0,
+                   (double)next_rand());
+  case 2:
+    return sprintf(out, "  \"%s %s %s\",\n", name(), name(), name());
+  default:
+    return sprintf(out, "  '%c', '%c', '%c',\n", 'a' + next_rand() % 26,
+                   'a' + next_rand() % 26, 'a' + next_rand() % 26);
+  }
+}
+
+int main(int argc, char **argv) {
+  int (*lines[4])(char *) = {ident_line, op_line, comment_line, literal_line};
+  char *mixes[4] = {"ident", "op", "comment", "literal"};
+  int mix = -1;
+
+  if (argc < 3) {
+    printf("usage: %s <ident|op|comment|literal|mixed> <size in KB> [seed]\n",
+           argv[0]);
+    return 1;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (!strcmp(argv[1], mixes[i])) {
+      mix = i;
+    }
+  }
+
+  if (mix < 0 && strcmp(argv[1], "mixed")) {
+    printf("Unknown mix %s\n", argv[1]);
+    return 1;
+  }
+
+  long size = atol(argv[2]) * 1024;
+
+  if (argc > 3) {
+    seed = atoi(argv[3]);
+  }
+
+  make_names();
+
+  char line[512];
+  long written = 0;
+
+  while (written < size) {
+    int len = lines[mix < 0 ? (int)(next_rand() % 4) : mix](line);
+    fwrite(line, 1, len, stdout);
+    written += len;
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+// microbenchmark for keyword recognition
+// compares the perfect hash in lookup_keyword against the linear strcmp scan
+// it replaced, over a mix of keywords and identifiers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lexer.h"
+
+#define N_WORDS 4096
+#define ROUNDS 2000
+
+// the old table, scanned in order for every identifier
+struct {
+  enum TokenKind token;
+  char *keyword;
+} linear_keywords[] = {
+    {AUTO, "auto"},         {BREAK, "break"},        {CASE, "case"},
+    {CHAR_TYPE, "char"},    {CONST, "const"},        {CONTINUE, "continue"},
+    {DEFAULT, "default"},   {DO, "do"},              {DOUBLE_TYPE, "double"},
+    {ELSE, "else"},         {ENUM, "enum"},          {EXTERN, "extern"},
+    {FLOAT_TYPE, "float"},  {FOR, "for"},            {GOTO, "goto"},
+    {IF, "if"},             {INT_TYPE, "int"},       {LONG_TYPE, "long"},
+    {REGISTER, "register"}, {RETURN, "return"},      {SHORT_TYPE, "short"},
+    {SIGNED, "signed"},     {SIZEOF, "sizeof"},      {STATIC, "static"},
+    {STRUCT, "struct"},     {SWITCH, "switch"},      {TYPEDEF, "typedef"},
+    {UNION, "union"},       {UNSIGNED, "unsigned"},  {VOID_TYPE, "void"},
+    {VOLATILE, "volatile"}, {WHILE, "while"},
+};
+
+#define N_KEYWORDS (int)(sizeof(linear_keywords) / sizeof(linear_keywords[0]))
+
+enum TokenKind linear_lookup(const char *str) {
+  for (int i = 0; i < N_KEYWORDS; i++) {
+    if (!strcmp(str, linear_keywords[i].keyword)) {
+      return linear_keywords[i].token;
+    }
+  }
+
+  return IDENT;
+}
+
+char words[N_WORDS][16];
+int lens[N_WORDS];
+
+// one in four words is a keyword, the rest are identifiers
+void make_words() {
+  unsigned int seed = 12345;
+
+  for (int i = 0; i < N_WORDS; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    if ((seed >> 16) % 4 == 0) {
+      strcpy(words[i], linear_keywords[(seed >> 8) % N_KEYWORDS].keyword);
+    } else {
+      int len = 1 + (seed >> 20) % 12;
+
+      for (int j = 0; j < len; j++) {
+        seed = seed * 1103515245 + 12345;
+        words[i][j] = "abcdefghijklmnopqrstuvwxyz_"[(seed >> 16) % 27];
+      }
+
+      words[i][len] = '\0';
+    }
+
+    lens[i] = strlen(words[i]);
+  }
+}
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main() {
+  make_words();
+
+  // both lookups must agree
+  for (int i = 0; i < N_WORDS; i++) {
+    if (linear_lookup(words[i]) != lookup_keyword(words[i], lens[i])) {
+      printf("Mismatch on \"%s\"\n", words[i]);
+      return 1;
+    }
+  }
+
+  volatile int sink = 0;
+  double total = (double)N_WORDS * ROUNDS;
+
+  double start = now();
+  for (int r = 0; r < ROUNDS; r++)
+    for (int i = 0; i < N_WORDS; i++)
+      sink += linear_lookup(words[i]);
+  double linear = now() - start;
+
+  start = now();
+  for (int r = 0; r < ROUNDS; r++)
+    for (int i = 0; i < N_WORDS; i++)
+      sink += lookup_keyword(words[i], lens[i]);
+  double hashed = now() - start;
+
+  printf("linear scan:  %8.1f M identifiers/sec\n", total / linear / 1e6);
+  printf("perfect hash: %8.1f M identifiers/sec\n", total / hashed / 1e6);
+  printf("speedup:      %8.1fx\n", linear / hashed);
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+// lexer throughput benchmark
+// usage: lex <file> [runs]
+// times get_token over the whole file serially and reports the best and
+// median run in MB/s and tokens/s
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../lexer.h"
+#include "../scan.h"
+#include "../source.h"
+
+// lexer internals, the benchmark drives get_token directly
+void setup_tables();
+void start_lexing(const char *p);
+struct Token get_token();
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(double *)a, y = *(double *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s <file> [runs]\n", argv[0]);
+    return 1;
+  }
+
+  int runs = argc > 2 ? atoi(argv[2]) : 10;
+  double *times = malloc(runs * sizeof(*times));
+  long n_tokens = 0;
+
+  source = map_source(argv[1]);
+  setup_scanner();
+  setup_tables();
+
+  // one untimed run to fault the file in and fill the interner
+  for (int r = -1; r < runs; r++) {
+    double start = now();
+    start_lexing(source->buf);
+    n_tokens = 0;
+
+    while (get_token().kind != END) {
+      n_tokens++;
+    }
+
+    if (r >= 0) {
+      times[r] = now() - start;
+    }
+  }
+
+  qsort(times, runs, sizeof(*times), compare_doubles);
+
+  double mb = source->len / 1e6;
+  double best = times[0], median = times[runs / 2];
+
+  printf("%s: %.1f MB, %ld tokens, %d runs\n", argv[1], mb, n_tokens, runs);
+  printf("  best:   %8.1f MB/s %8.1f M tokens/s\n", mb / best,
+         n_tokens / best / 1e6);
+  printf("  median: %8.1f MB/s %8.1f M tokens/s\n", mb / median,
+         n_tokens / median / 1e6);
+
+  return 0;
+}
@@ -0,0 +1,150 @@
+// macro expansion stress benchmark
+// usage: macros [runs]
+// preprocesses generated sources built around X-macro tables, where one
+// big table macro is expanded again under several definitions of X, and
+// around deeply nested calls that only stay linear if arguments are
+// expanded once
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../lexer.h"
+#include "../preprocessor.h"
+#include "../scan.h"
+#include "../source.h"
+
+#define TABLE_SIZE 500
+#define TABLE_USES 200
+#define NEST_DEPTH 64
+#define NEST_USES 100
+
+void setup_tables();
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(double *)a, y = *(double *)b;
+  return x < y ? -1 : x > y;
+}
+
+void gen_xmacro(FILE *out) {
+  fprintf(out, "#define TABLE");
+
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    fprintf(out, " \\\n  X(field%d, %d, FLAG(%d))", i, i, i % 7);
+  }
+
+  fprintf(out, "\n#define FLAG(n) (1 << (n))\n");
+  fprintf(out, "#define CAT(a, b) a##b\n");
+
+  for (int i = 0; i < TABLE_USES; i++) {
+    switch (i % 4) {
+    case 0:
+      fprintf(out, "#define X(name, value, flags) CAT(name, _%d) = value,\n",
+              i);
+      fprintf(out, "enum e%d { TABLE };\n", i);
+      break;
+    case 1:
+      fprintf(out, "#define X(name, value, flags) #name,\n");
+      fprintf(out, "char *names%d[] = { TABLE };\n", i);
+      break;
+    case 2:
+      fprintf(out, "#define X(name, value, flags) flags | value,\n");
+      fprintf(out, "int flags%d[] = { TABLE };\n", i);
+      break;
+    case 3:
+      fprintf(out, "#define X(name, value, flags) int name;\n");
+      fprintf(out, "struct s%d { TABLE };\n", i);
+      break;
+    }
+
+    fprintf(out, "#undef X\n");
+  }
+}
+
+// each level passes its argument on twice, but only one copy is used
+void gen_nested(FILE *out) {
+  fprintf(out, "#define FIRST(a, b) a\n");
+  fprintf(out, "#define F(x) FIRST(x, x) + 1\n");
+
+  for (int i = 0; i < NEST_USES; i++) {
+    fprintf(out, "int n%d = ", i);
+
+    for (int j = 0; j < NEST_DEPTH; j++) {
+      fprintf(out, "F(");
+    }
+
+    fprintf(out, "%d", i);
+
+    for (int j = 0; j < NEST_DEPTH; j++) {
+      fprintf(out, ")");
+    }
+
+    fprintf(out, ";\n");
+  }
+}
+
+void run(char *name, void (*gen)(FILE *), int runs) {
+  FILE *stream = tmpfile();
+  gen(stream);
+  rewind(stream);
+
+  struct Source *src = read_source(stream, name);
+  fclose(stream);
+
+  double *times = malloc(runs * sizeof(*times));
+  long n_tokens = 0;
+
+  // one untimed run to fill the interner
+  // each run pushes the source on the empty base and pops it once done
+  for (int r = -1; r < runs; r++) {
+    double start = now();
+    push_input(src);
+    n_tokens = 0;
+
+    while (preprocess_token().kind != END) {
+      n_tokens++;
+    }
+
+    pop_input();
+
+    if (r >= 0) {
+      times[r] = now() - start;
+    }
+  }
+
+  qsort(times, runs, sizeof(*times), compare_doubles);
+
+  double best = times[0], median = times[runs / 2];
+
+  printf("%s: %.1f KB in, %ld tokens out, %d runs\n", name, src->len / 1e3,
+         n_tokens, runs);
+  printf("  best:   %8.1f ms %8.1f M tokens/s\n", best * 1e3,
+         n_tokens / best / 1e6);
+  printf("  median: %8.1f ms %8.1f M tokens/s\n", median * 1e3,
+         n_tokens / median / 1e6);
+
+  free(times);
+}
+
+int main(int argc, char **argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 10;
+
+  setup_scanner();
+  setup_tables();
+  setup_preprocessor();
+
+  // the bottom input is never popped, so runs go on top of an empty one
+  FILE *empty = tmpfile();
+  push_input(read_source(empty, "base"));
+  fclose(empty);
+
+  run("xmacro", gen_xmacro, runs);
+  run("nested", gen_nested, runs);
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+// microbenchmark for numeric literals
+// lexes a table initialiser full of integer and floating literals with
+// lex_number and compares it against finding the end of each literal and
+// converting it with strtoul/strtod, which is what the lexer used to need
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lexer.h"
+
+// fills in the char classes lex_number relies on
+void setup_tables();
+
+#define N_LITERALS 65536
+#define ROUNDS 50
+
+char *text;
+int starts[N_LITERALS];
+int is_float[N_LITERALS];
+
+unsigned int seed = 12345;
+
+unsigned int next_rand() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// like a generated lookup table, half ints in decimal and hex, half doubles
+// of varying precision
+void make_literals() {
+  text = malloc(N_LITERALS * 40);
+  int len = 0;
+
+  for (int i = 0; i < N_LITERALS; i++) {
+    starts[i] = len;
+    unsigned int r = next_rand();
+
+    switch (r % 4) {
+    case 0:
+      len += sprintf(text + len, "%u", next_rand());
+      break;
+    case 1:
+      len += sprintf(text + len, "0x%08x", next_rand());
+      break;
+    case 2:
+      is_float[i] = 1;
+      len += sprintf(text + len, "%.6f", next_rand() / 1000.0);
+      break;
+    case 3:
+      is_float[i] = 1;
+      len += sprintf(text + len, "%.17g",
+                     (double)next_rand() / (next_rand() + 1) * 1e-5);
+      break;
+    }
+
+    len += sprintf(text + len, ", ");
+  }
+}
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main() {
+  setup_tables();
+  make_literals();
+
+  // lex_number must agree with the c library
+  for (int i = 0; i < N_LITERALS; i++) {
+    struct Token token;
+    const char *p = text + starts[i];
+    lex_number(p, p + strlen(p), &token);
+
+    if (is_float[i] ? token.float_literal != strtod(p, NULL)
+                    : token.int_literal != strtoul(p, NULL, 0)) {
+      printf("Mismatch on %.20s\n", p);
+      return 1;
+    }
+  }
+
+  volatile double sink = 0;
+  double total = (double)N_LITERALS * ROUNDS;
+  const char *end = text + strlen(text);
+
+  double start = now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < N_LITERALS; i++) {
+      const char *p = text + starts[i];
+      const char *q = p;
+
+      // find the end of the literal, then convert it
+      while (*q != ',') {
+        q++;
+      }
+
+      if (memchr(p, '.', q - p)) {
+        sink += strtod(p, NULL);
+      } else {
+        sink += strtoul(p, NULL, 0);
+      }
+    }
+  }
+  double libc = now() - start;
+
+  start = now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < N_LITERALS; i++) {
+      struct Token token;
+      lex_number(text + starts[i], end, &token);
+      sink += token.kind == FLOAT ? token.float_literal : token.int_literal;
+    }
+  }
+  double fused = now() - start;
+
+  printf("strtoul/strtod: %8.1f M literals/sec\n", total / libc / 1e6);
+  printf("lex_number:     %8.1f M literals/sec\n", total / fused / 1e6);
+  printf("speedup:        %8.1fx\n", libc / fused);
+
+  return 0;
+}
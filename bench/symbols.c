@@ -0,0 +1,66 @@
+// symbol table benchmark
+// usage: symbols [lookups]
+// grows the file scope symbol table in steps and times lookups of random
+// globals at each size, which should stay flat as the table grows
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../intern.h"
+#include "../symbols.h"
+
+#define MAX_GLOBALS 100000
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  long lookups = argc > 1 ? atol(argv[1]) : 10000000;
+
+  unsigned int *names = malloc(MAX_GLOBALS * sizeof(*names));
+  int sizes[] = {100, 1000, 10000, MAX_GLOBALS};
+  int n_globals = 0;
+
+  for (int s = 0; s < (int)(sizeof(sizes) / sizeof(*sizes)); s++) {
+    double start = now();
+
+    for (; n_globals < sizes[s]; n_globals++) {
+      char buf[32];
+      int len = sprintf(buf, "global_%d", n_globals);
+      names[n_globals] = intern(buf, len);
+      add_global(names[n_globals]);
+    }
+
+    double insert = now() - start;
+
+    // xorshift so the lookups jump around the table
+    unsigned int x = 2463534242u;
+    long found = 0;
+
+    start = now();
+
+    for (long i = 0; i < lookups; i++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      found += lookup_symbol(names[x % n_globals]) != NULL;
+    }
+
+    double elapsed = now() - start;
+
+    if (found != lookups) {
+      printf("lookup failed\n");
+      return 1;
+    }
+
+    printf("%6d globals: insert %7.2f ms, %6.1f ns per lookup\n", n_globals,
+           insert * 1e3, elapsed / lookups * 1e9);
+  }
+
+  free(names);
+
+  return 0;
+}
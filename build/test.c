@@ -0,0 +1,2 @@
+#include "test.h"
+int main() { return before; }
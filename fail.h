@@ -1,12 +1,36 @@
 #ifndef FAIL_HEADER
 #define FAIL_HEADER
 
+#include <setjmp.h>
+
 #define FAIL fail(__LINE__, __FILE__)
 
-extern int line;
-extern int line_col;
-extern char *file;
+// location reported by fail
+// NO_LOC means the location of the current token
+extern _Thread_local unsigned int fail_loc;
+
+// if set fail records the error in caught_error and jumps here instead of
+// reporting it and exiting
+// used where an error may not be the one to report, see parse_bodies
+extern _Thread_local jmp_buf *fail_jump;
 
 void fail(int line, char *file);
 
+// print part of the message of an error, before the FAIL that reports it
+// while fail_jump is set the message is held back for fail to record
+void error_printf(const char *fmt, ...);
+
+// an error that was recorded instead of reported
+struct Error {
+  unsigned int loc;
+  int line; // where in the compiler it was caught
+  char *file;
+  char *msg; // malloc'd, NULL if there was no message
+};
+
+extern _Thread_local struct Error caught_error;
+
+// print error like fail does and exit
+void report_error(struct Error *error);
+
 #endif
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fail.h"
+#include "flat.h"
+#include "intern.h"
+
+unsigned int add_node(struct FlatAst *ast, enum FlatKind kind, int op,
+                      unsigned int l, unsigned int r) {
+  if (ast->len == ast->cap) {
+    ast->cap = ast->cap ? 2 * ast->cap : 64;
+    ast->kinds = realloc(ast->kinds, ast->cap * sizeof(*ast->kinds));
+    ast->ops = realloc(ast->ops, ast->cap * sizeof(*ast->ops));
+    ast->l = realloc(ast->l, ast->cap * sizeof(*ast->l));
+    ast->r = realloc(ast->r, ast->cap * sizeof(*ast->r));
+    ast->data = realloc(ast->data, ast->cap * sizeof(*ast->data));
+  }
+
+  ast->kinds[ast->len] = kind;
+  ast->ops[ast->len] = op;
+  ast->l[ast->len] = l;
+  ast->r[ast->len] = r;
+  ast->data[ast->len] = (union FlatData){0};
+
+  return ast->len++;
+}
+
+// make room for a list of n nodes, returns where its length is stored
+// the nodes are filled in as they are flattened
+unsigned int add_list(struct FlatAst *ast, int n) {
+  while (ast->lists_len + n + 1 > ast->lists_cap) {
+    ast->lists_cap = ast->lists_cap ? 2 * ast->lists_cap : 64;
+    ast->lists = realloc(ast->lists, ast->lists_cap * sizeof(*ast->lists));
+  }
+
+  unsigned int list = ast->lists_len;
+
+  ast->lists[list] = n;
+  ast->lists_len += n + 1;
+
+  return list;
+}
+
+unsigned int flatten_expr(struct FlatAst *ast, struct Expr *expr) {
+  unsigned int node, l, r;
+
+  if (expr == NULL) {
+    return NO_NODE;
+  }
+
+  switch (expr->kind) {
+  case E_CONST:
+    node = add_node(ast, N_CONST, expr->cnst.kind, NO_NODE, NO_NODE);
+
+    switch (expr->cnst.kind) {
+    case C_INT:
+      ast->data[node].int_literal = expr->cnst.int_literal;
+      break;
+    case C_CHAR:
+      ast->data[node].char_literal = expr->cnst.char_literal;
+      break;
+    case C_STR:
+      ast->data[node].str_literal = expr->cnst.str_literal.ptr;
+      ast->r[node] = expr->cnst.str_literal.strlen;
+      break;
+    }
+
+    return node;
+  case E_GLOBAL:
+    node = add_node(ast, N_GLOBAL, 0, NO_NODE, NO_NODE);
+    ast->data[node].global = expr->global;
+    return node;
+  case E_VAR:
+    node = add_node(ast, N_VAR, 0, NO_NODE, NO_NODE);
+    ast->data[node].var = expr->var;
+    return node;
+  case E_FUNC:
+    node = add_node(ast, N_FUNC, 0, NO_NODE, NO_NODE);
+    ast->data[node].func = expr->func;
+    return node;
+  case E_UNOP:
+    l = flatten_expr(ast, expr->unop.expr);
+    return add_node(ast, N_UNOP, expr->unop.op, l, NO_NODE);
+  case E_BINOP:
+    l = flatten_expr(ast, expr->binop.l);
+    r = flatten_expr(ast, expr->binop.r);
+    return add_node(ast, N_BINOP, expr->binop.op, l, r);
+  case E_CALL:
+    l = flatten_expr(ast, expr->call.func_expr);
+    r = add_list(ast, expr->call.n_args);
+
+    for (int i = 0; i < expr->call.n_args; i++) {
+      unsigned int arg = flatten_expr(ast, expr->call.args[i]);
+      ast->lists[r + 1 + i] = arg;
+    }
+
+    return add_node(ast, N_CALL, 0, l, r);
+  case E_MEMBER:
+    l = flatten_expr(ast, expr->member.expr);
+    node = add_node(ast, N_MEMBER, expr->member.arrow, l, NO_NODE);
+    ast->data[node].member = expr->member.member;
+    return node;
+  case E_COND:
+    l = flatten_expr(ast, expr->cond.cond);
+    r = add_list(ast, 2);
+
+    node = flatten_expr(ast, expr->cond.then);
+    ast->lists[r + 1] = node;
+    node = flatten_expr(ast, expr->cond.els);
+    ast->lists[r + 2] = node;
+
+    return add_node(ast, N_COND, 0, l, r);
+  case E_CAST:
+    l = flatten_expr(ast, expr->cast.expr);
+    node = add_node(ast, N_CAST, 0, l, NO_NODE);
+    ast->data[node].type = expr->cast.type;
+    return node;
+  }
+
+  FAIL;
+  return NO_NODE;
+}
+
+unsigned int flatten_block(struct FlatAst *ast, struct BlockStmt *block);
+
+unsigned int flatten_stmt(struct FlatAst *ast, struct Stmt *stmt) {
+  unsigned int node, l, r;
+
+  // an empty statement like the body of `for (;;);`
+  if (stmt == NULL) {
+    return NO_NODE;
+  }
+
+  switch (stmt->kind) {
+  case S_BLOCK:
+    return flatten_block(ast, stmt->block);
+  case S_EXPR:
+    l = flatten_expr(ast, stmt->expr);
+    return add_node(ast, N_EXPR, 0, l, NO_NODE);
+  case S_RETURN:
+    l = flatten_expr(ast, stmt->expr);
+    return add_node(ast, N_RETURN, 0, l, NO_NODE);
+  case S_IF:
+    l = flatten_expr(ast, stmt->if_stmt.cond);
+    r = add_list(ast, 2);
+
+    node = flatten_stmt(ast, stmt->if_stmt.if_block);
+    ast->lists[r + 1] = node;
+    node = flatten_stmt(ast, stmt->if_stmt.else_block);
+    ast->lists[r + 2] = node;
+
+    return add_node(ast, N_IF, 0, l, r);
+  case S_WHILE:
+    l = flatten_expr(ast, stmt->while_stmt.cond);
+    r = flatten_stmt(ast, stmt->while_stmt.block);
+    return add_node(ast, N_WHILE, 0, l, r);
+  case S_FOR:
+    r = add_list(ast, 4);
+
+    node = flatten_expr(ast, stmt->for_stmt.init);
+    ast->lists[r + 1] = node;
+    node = flatten_expr(ast, stmt->for_stmt.cond);
+    ast->lists[r + 2] = node;
+    node = flatten_expr(ast, stmt->for_stmt.iter);
+    ast->lists[r + 3] = node;
+    node = flatten_stmt(ast, stmt->for_stmt.block);
+    ast->lists[r + 4] = node;
+
+    return add_node(ast, N_FOR, 0, NO_NODE, r);
+  }
+
+  FAIL;
+  return NO_NODE;
+}
+
+unsigned int flatten_block(struct FlatAst *ast, struct BlockStmt *block) {
+  int n = 0;
+
+  for (struct BlockStmt *cur = block; cur; cur = cur->next) {
+    n++;
+  }
+
+  unsigned int list = add_list(ast, n);
+
+  for (int i = 0; block; block = block->next, i++) {
+    unsigned int node = flatten_stmt(ast, block->stmt);
+    ast->lists[list + 1 + i] = node;
+  }
+
+  return add_node(ast, N_BLOCK, 0, NO_NODE, list);
+}
+
+struct FlatAst *flatten_func(struct Func *func) {
+  struct FlatAst *ast = calloc(1, sizeof(*ast));
+
+  ast->root = flatten_block(ast, func->stmt);
+
+  return ast;
+}
+
+void free_flat(struct FlatAst *ast) {
+  free(ast->kinds);
+  free(ast->ops);
+  free(ast->l);
+  free(ast->r);
+  free(ast->data);
+  free(ast->lists);
+  free(ast);
+}
+
+void flat_types(struct FlatAst *ast, struct Type **types) {
+  struct Type *int_type = canon_type(&(struct Type){.kind = T_INT});
+
+  for (int i = 0; i < ast->len; i++) {
+    unsigned int l = ast->l[i], r = ast->r[i];
+
+    switch (ast->kinds[i]) {
+    case N_CONST:
+      types[i] = int_type;
+      break;
+    case N_GLOBAL:
+      types[i] = ast->data[i].global->type;
+      break;
+    case N_VAR:
+      types[i] = ast->data[i].var->type;
+      break;
+    case N_FUNC:
+      types[i] = canon_type(
+          &(struct Type){.kind = T_FUNC, .func_sig = ast->data[i].func->sig});
+      break;
+    case N_UNOP:
+      types[i] = unop_type(ast->ops[i], types[l]);
+      break;
+    case N_BINOP:
+      types[i] = binop_type(ast->ops[i], types[l], types[r]);
+      break;
+    case N_CALL:
+      types[i] = call_type(types[l]);
+      break;
+    case N_MEMBER:
+      types[i] = ast->data[i].member->type;
+      break;
+    case N_COND:
+      types[i] = types[ast->lists[r + 1]];
+      break;
+    case N_CAST:
+      types[i] = ast->data[i].type;
+      break;
+    default:
+      types[i] = NULL;
+      break;
+    }
+  }
+}
+
+// print a reference to a node, - if there is none
+void debug_node_ref(unsigned int node) {
+  if (node == NO_NODE) {
+    printf("-");
+  } else {
+    printf("%%%u", node);
+  }
+}
+
+void debug_list(struct FlatAst *ast, unsigned int list, char *sep) {
+  for (unsigned int i = 0; i < ast->lists[list]; i++) {
+    if (i) {
+      printf("%s", sep);
+    }
+
+    debug_node_ref(ast->lists[list + 1 + i]);
+  }
+}
+
+void debug_flat(struct FlatAst *ast) {
+  for (int i = 0; i < ast->len; i++) {
+    unsigned int l = ast->l[i], r = ast->r[i];
+    struct Constant cnst;
+
+    printf("  %%%d: ", i);
+
+    switch (ast->kinds[i]) {
+    case N_CONST:
+      cnst.kind = ast->ops[i];
+
+      if (cnst.kind == C_STR) {
+        cnst.str_literal.ptr = ast->data[i].str_literal;
+        cnst.str_literal.strlen = r;
+      } else if (cnst.kind == C_CHAR) {
+        cnst.char_literal = ast->data[i].char_literal;
+      } else {
+        cnst.int_literal = ast->data[i].int_literal;
+      }
+
+      debug_const(&cnst);
+      break;
+    case N_GLOBAL:
+      printf("%s", intern_str(ast->data[i].global->name));
+      break;
+    case N_VAR:
+      printf("%s", intern_str(ast->data[i].var->name));
+      break;
+    case N_FUNC:
+      printf("%s", intern_str(ast->data[i].func->name));
+      break;
+    case N_UNOP:
+      if (ast->ops[i] == O_POST_INC || ast->ops[i] == O_POST_DEC) {
+        debug_node_ref(l);
+        printf("%s", unop_repr[ast->ops[i]]);
+      } else {
+        printf("%s", unop_repr[ast->ops[i]]);
+        debug_node_ref(l);
+      }
+      break;
+    case N_BINOP:
+      debug_node_ref(l);
+
+      if (ast->ops[i] == O_INDEX) {
+        printf("[");
+        debug_node_ref(r);
+        printf("]");
+      } else {
+        printf(" %s ", repr[ast->ops[i]]);
+        debug_node_ref(r);
+      }
+      break;
+    case N_CALL:
+      debug_node_ref(l);
+      printf("(");
+      debug_list(ast, r, ", ");
+      printf(")");
+      break;
+    case N_MEMBER:
+      debug_node_ref(l);
+      printf("%s%s", ast->ops[i] ? "->" : ".",
+             intern_str(ast->data[i].member->name));
+      break;
+    case N_COND:
+      debug_node_ref(l);
+      printf(" ? ");
+      debug_node_ref(ast->lists[r + 1]);
+      printf(" : ");
+      debug_node_ref(ast->lists[r + 2]);
+      break;
+    case N_CAST:
+      printf("(");
+      debug_type(ast->data[i].type);
+      printf(")");
+      debug_node_ref(l);
+      break;
+    case N_EXPR:
+      printf("expr ");
+      debug_node_ref(l);
+      break;
+    case N_RETURN:
+      printf("return ");
+      debug_node_ref(l);
+      break;
+    case N_IF:
+      printf("if ");
+      debug_node_ref(l);
+      printf(" then ");
+      debug_node_ref(ast->lists[r + 1]);
+      printf(" else ");
+      debug_node_ref(ast->lists[r + 2]);
+      break;
+    case N_WHILE:
+      printf("while ");
+      debug_node_ref(l);
+      printf(" do ");
+      debug_node_ref(r);
+      break;
+    case N_FOR:
+      printf("for (");
+      debug_node_ref(ast->lists[r + 1]);
+      printf("; ");
+      debug_node_ref(ast->lists[r + 2]);
+      printf("; ");
+      debug_node_ref(ast->lists[r + 3]);
+      printf(") ");
+      debug_node_ref(ast->lists[r + 4]);
+      break;
+    case N_BLOCK:
+      printf("block ");
+      debug_list(ast, r, " ");
+      break;
+    }
+
+    printf("\n");
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef FLAT_HEADER
+#define FLAT_HEADER
+
+#include "ast.h"
+#include "symbols.h"
+#include "types.h"
+
+// flat AST
+// the nodes of a function body live in parallel arrays and refer to each
+// other by 32-bit index instead of by pointer
+//
+// nodes are numbered in the order they finish, so the operands of a node
+// always come before it and a pass over the whole body is one loop
+
+// index of a node, NO_NODE for a missing optional part
+#define NO_NODE 0xffffffffu
+
+enum FlatKind {
+  // expressions
+  N_CONST,  // op is the constant kind
+  N_GLOBAL,
+  N_VAR,
+  N_FUNC,
+  N_UNOP,   // op l
+  N_BINOP,  // l op r
+  N_CALL,   // l is the function, r is a list of arguments
+  N_MEMBER, // l is the struct, op is set for ->
+  N_COND,   // l is the condition, r is a list of then and else
+  N_CAST,   // l, the type is in data
+
+  // statements
+  N_EXPR,   // l
+  N_RETURN, // l, which can be NO_NODE
+  N_IF,     // l is the condition, r is a list of then and else
+  N_WHILE,  // l is the condition, r is the body
+  N_FOR,    // r is a list of init, cond, iter and body
+  N_BLOCK,  // r is a list of statements
+};
+
+union FlatData {
+  int int_literal;
+  char char_literal;
+  char *str_literal; // length is in r
+  struct Var *var;
+  struct Global *global;
+  struct Func *func;
+  struct Member *member;
+  struct Type *type;
+};
+
+struct FlatAst {
+  int len;
+  int cap;
+
+  unsigned char *kinds; // enum FlatKind
+  unsigned char *ops;   // operator, constant kind, or arrow for members
+  unsigned int *l;
+  unsigned int *r;
+  union FlatData *data;
+
+  // lists of nodes for calls, blocks, ifs and fors
+  // a list is its length followed by the nodes, r points at the length
+  unsigned int *lists;
+  int lists_len;
+  int lists_cap;
+
+  unsigned int root; // block of the body, always the last node
+};
+
+// flatten the body of a defined function
+struct FlatAst *flatten_func(struct Func *func);
+void free_flat(struct FlatAst *ast);
+
+// type of every node in one pass, types[i] is NULL for statements
+void flat_types(struct FlatAst *ast, struct Type **types);
+
+// one node per line, in order
+void debug_flat(struct FlatAst *ast);
+
+#endif
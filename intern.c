@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+// strings are copied into chunks that are never freed
+#define INTERN_CHUNK (1 << 16)
+
+struct Interned {
+  char *str;
+  int len;
+  unsigned int hash;
+};
+
+// interned strings indexed by id
+struct Interned *interned = NULL;
+unsigned int n_interned = 1; // id 0 is reserved
+unsigned int interned_cap = 0;
+
+// open addressing table of ids, 0 is an empty slot
+unsigned int *intern_slots = NULL;
+unsigned int n_intern_slots = 0;
+
+char *intern_chunk = NULL;
+int intern_chunk_left = 0;
+
+// FNV-1a
+unsigned int hash_str(const char *str, int len) {
+  unsigned int hash = 2166136261u;
+
+  for (int i = 0; i < len; i++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+char *store_str(const char *str, int len) {
+  if (len + 1 > intern_chunk_left) {
+    int size = len + 1 > INTERN_CHUNK ? len + 1 : INTERN_CHUNK;
+    intern_chunk = malloc(size);
+    intern_chunk_left = size;
+  }
+
+  char *copy = intern_chunk;
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  intern_chunk += len + 1;
+  intern_chunk_left -= len + 1;
+
+  return copy;
+}
+
+// double the slot table and reinsert every id
+void grow_intern_slots() {
+  unsigned int n = n_intern_slots ? n_intern_slots * 2 : 1024;
+  unsigned int *slots = calloc(n, sizeof(*slots));
+
+  for (unsigned int id = 1; id < n_interned; id++) {
+    unsigned int i = interned[id].hash & (n - 1);
+
+    while (slots[i]) {
+      i = (i + 1) & (n - 1);
+    }
+
+    slots[i] = id;
+  }
+
+  free(intern_slots);
+  intern_slots = slots;
+  n_intern_slots = n;
+}
+
+unsigned int intern(const char *str, int len) {
+  // keep load factor under a half
+  if (n_interned * 2 >= n_intern_slots) {
+    grow_intern_slots();
+  }
+
+  unsigned int hash = hash_str(str, len);
+  unsigned int mask = n_intern_slots - 1;
+  unsigned int i = hash & mask;
+
+  while (intern_slots[i]) {
+    struct Interned *s = &interned[intern_slots[i]];
+
+    if (s->hash == hash && s->len == len && !memcmp(s->str, str, len)) {
+      return intern_slots[i];
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  if (n_interned >= interned_cap) {
+    interned_cap = interned_cap ? interned_cap * 2 : 1024;
+    interned = realloc(interned, interned_cap * sizeof(*interned));
+  }
+
+  unsigned int id = n_interned++;
+  interned[id] = (struct Interned){store_str(str, len), len, hash};
+  intern_slots[i] = id;
+
+  return id;
+}
+
+char *intern_str(unsigned int id) { return interned[id].str; }
+
+int intern_len(unsigned int id) { return interned[id].len; }
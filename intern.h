@@ -0,0 +1,14 @@
+#ifndef INTERN_HEADER
+#define INTERN_HEADER
+
+// global string interner
+// every distinct string gets a 32-bit id, equal strings get equal ids
+// id 0 is never handed out so it can be used for "no name"
+
+unsigned int intern(const char *str, int len);
+
+// interned strings are NUL terminated and never move
+char *intern_str(unsigned int id);
+int intern_len(unsigned int id);
+
+#endif
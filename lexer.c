@@ -1,21 +1,92 @@
-#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "fail.h"
+#include "intern.h"
 #include "lexer.h"
+#include "number.h"
+#include "preprocessor.h"
+#include "scan.h"
+#include "source.h"
 
-int line = 1;
-int line_col = 0;
-char *file;
+_Thread_local unsigned int fail_loc = NO_LOC;
+_Thread_local jmp_buf *fail_jump = NULL;
+_Thread_local struct Error caught_error;
 
-void fail(int _line, char *_file) {
-  printf("On line %d column %d in file %s\n", line, line_col, file);
-  printf("Error caught in compiler src line %d, file %s\n", _line, _file);
+// message held back while fail_jump is set
+_Thread_local char *held_msg = NULL;
+_Thread_local int held_len = 0;
+_Thread_local int held_cap = 0;
+
+void error_printf(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  if (!fail_jump) {
+    vprintf(fmt, args);
+    va_end(args);
+    return;
+  }
+
+  va_list again;
+  va_copy(again, args);
+  int len = vsnprintf(NULL, 0, fmt, args);
+
+  if (held_len + len + 1 > held_cap) {
+    while (held_len + len + 1 > held_cap) {
+      held_cap = held_cap ? 2 * held_cap : 128;
+    }
+
+    held_msg = realloc(held_msg, held_cap);
+  }
+
+  vsnprintf(held_msg + held_len, len + 1, fmt, again);
+  held_len += len;
+
+  va_end(again);
+  va_end(args);
+}
+
+void report_error(struct Error *error) {
+  struct Source *src = loc_source(error->loc);
+  int line, line_col;
+
+  // line and column are only worked out now that they are needed
+  loc_line_col(error->loc, &line, &line_col);
+
+  if (error->msg) {
+    printf("%s", error->msg);
+  }
+
+  printf("On line %d column %d in file %s\n", line, line_col,
+         src ? src->name : "?");
+  printf("Error caught in compiler src line %d, file %s\n", error->line,
+         error->file);
   exit(1);
 }
 
+void fail(int _line, char *_file) {
+  unsigned int loc = fail_loc == NO_LOC ? cur_token.loc : fail_loc;
+
+  if (fail_jump) {
+    // the held message goes with the error
+    caught_error = (struct Error){loc, _line, _file, held_msg};
+    held_msg = NULL;
+    held_len = held_cap = 0;
+
+    fail_loc = NO_LOC;
+    longjmp(*fail_jump, 1);
+  }
+
+  report_error(&(struct Error){loc, _line, _file, NULL});
+}
+
 char *token_repr[256] = {
     [L_PAREN] = "\"(\"",
     [R_PAREN] = "\")\"",
@@ -30,6 +101,7 @@ char *token_repr[256] = {
     [COLON] = "\":\"",
     [IDENT] = "identifier",
     [INTEGER] = "int literal",
+    [FLOAT] = "float literal",
     [STRING] = "string literal",
     [CHAR] = "char literal",
     [IF] = "if",
@@ -42,10 +114,28 @@ char *token_repr[256] = {
     [UNION] = "union",
     [ENUM] = "enum",
     [TYPEDEF] = "typedef",
+    [DO] = "do",
+    [SWITCH] = "switch",
+    [CASE] = "case",
+    [DEFAULT] = "default",
+    [CONTINUE] = "continue",
+    [GOTO] = "goto",
+    [SIZEOF] = "sizeof",
+    [AUTO] = "auto",
+    [STATIC] = "static",
+    [EXTERN] = "extern",
+    [REGISTER] = "register",
+    [CONST] = "const",
+    [VOLATILE] = "volatile",
+    [SIGNED] = "signed",
+    [UNSIGNED] = "unsigned",
     [INT_TYPE] = "\"int\"",
     [CHAR_TYPE] = "\"char\"",
     [VOID_TYPE] = "\"void\"",
     [FLOAT_TYPE] = "\"float\"",
+    [SHORT_TYPE] = "\"short\"",
+    [LONG_TYPE] = "\"long\"",
+    [DOUBLE_TYPE] = "\"double\"",
     [AMP] = "ampersand",
     [STAR] = "\"*\"",
     [SLASH] = "\"/\"",
@@ -61,237 +151,1298 @@ char *token_repr[256] = {
     [NOT] = "\"!\"",
     [OR] = "\"||\"",
     [AND] = "\"&&\"",
+    [QUESTION] = "\"?\"",
+    [PIPE] = "\"|\"",
+    [CARET] = "\"^\"",
+    [TILDE] = "\"~\"",
+    [SHL] = "\"<<\"",
+    [SHR] = "\">>\"",
+    [INC] = "\"++\"",
+    [DEC] = "\"--\"",
+    [ARROW] = "\"->\"",
+    [ELLIPSIS] = "\"...\"",
+    [ADD_ASSIGN] = "\"+=\"",
+    [SUB_ASSIGN] = "\"-=\"",
+    [MUL_ASSIGN] = "\"*=\"",
+    [DIV_ASSIGN] = "\"/=\"",
+    [MOD_ASSIGN] = "\"%=\"",
+    [AND_ASSIGN] = "\"&=\"",
+    [OR_ASSIGN] = "\"|=\"",
+    [XOR_ASSIGN] = "\"^=\"",
+    [SHL_ASSIGN] = "\"<<=\"",
+    [SHR_ASSIGN] = "\">>=\"",
+    [HASH] = "\"#\"",
+    [HASH_HASH] = "\"##\"",
     [ERR] = "error_token",
     [START] = "start",
     [END] = "EOF",
 };
 
-FILE *stream; // current stream
+struct Source *source; // current source
 
-char cur_char;
-char next_char;
+// character classes
+// every char that can start a punctuator gets its own class so that the
+// punctuator dfa can use classes as its input alphabet
+enum CharClass {
+  CC_OTHER,
+  CC_SPACE,
+  CC_ALPHA, // letters and _
+  CC_DIGIT,
+  CC_QUOTE,
+  CC_DQUOTE,
 
-// setup global so that read_char can be called
-void setup_lexer() { next_char = fgetc(stream); read_token(); }
+  // punctuators
+  CC_L_PAREN,
+  CC_R_PAREN,
+  CC_L_SQUARE,
+  CC_R_SQUARE,
+  CC_L_BRACE,
+  CC_R_BRACE,
+  CC_DOT,
+  CC_COMMA,
+  CC_SEMICOLON,
+  CC_COLON,
+  CC_QUESTION,
+  CC_EQ,
+  CC_NOT,
+  CC_LT,
+  CC_GT,
+  CC_PLUS,
+  CC_MINUS,
+  CC_STAR,
+  CC_SLASH,
+  CC_MOD,
+  CC_AMP,
+  CC_PIPE,
+  CC_CARET,
+  CC_TILDE,
+  CC_HASH,
 
-char read_char() {
-  if (cur_char == '\n') {
-    line++;
-    line_col = 0;
-  }
+  N_CHAR_CLASSES
+};
+
+// class of every byte, non-ascii bytes are CC_OTHER
+// used instead of ctype.h so lexing doesn't depend on the locale
+unsigned char char_class[256] = {
+    [' '] = CC_SPACE,     ['\t'] = CC_SPACE,     ['\n'] = CC_SPACE,
+    ['\v'] = CC_SPACE,    ['\f'] = CC_SPACE,     ['\r'] = CC_SPACE,
+
+    ['_'] = CC_ALPHA, // letters and digits are filled in by setup_tables
+
+    ['\''] = CC_QUOTE,    ['"'] = CC_DQUOTE,
+
+    ['('] = CC_L_PAREN,   [')'] = CC_R_PAREN,   ['['] = CC_L_SQUARE,
+    [']'] = CC_R_SQUARE,  ['{'] = CC_L_BRACE,   ['}'] = CC_R_BRACE,
+    ['.'] = CC_DOT,       [','] = CC_COMMA,     [';'] = CC_SEMICOLON,
+    [':'] = CC_COLON,     ['?'] = CC_QUESTION,  ['='] = CC_EQ,
+    ['!'] = CC_NOT,       ['<'] = CC_LT,        ['>'] = CC_GT,
+    ['+'] = CC_PLUS,      ['-'] = CC_MINUS,     ['*'] = CC_STAR,
+    ['/'] = CC_SLASH,     ['%'] = CC_MOD,       ['&'] = CC_AMP,
+    ['|'] = CC_PIPE,      ['^'] = CC_CARET,     ['~'] = CC_TILDE,
+    ['#'] = CC_HASH,
+};
+
+#define CLASS(c) char_class[(unsigned char)(c)]
+
+void setup_tables();
+void lex_tokens();
+
+// the lexer walks a cursor over the source buffer
+// cursor points at next_char, cur_char is the char before it
+// thread local so that chunks can be lexed in parallel, see lex_parallel
+_Thread_local const char *cursor;
+_Thread_local const char *buf_end;
+
+_Thread_local char cur_char;
+_Thread_local char next_char;
+
+// set while a file is lexed up front
+// errors abandon the lexing instead of being reported, a worker's chunk
+// may have been split inside a comment and any of the file may be skipped
+// by the preprocessor, so it is lexed again as needed if it matters
+_Thread_local jmp_buf *speculative = NULL;
+
+#define BAIL_IF_SPECULATIVE                                                    \
+  if (speculative)                                                             \
+  longjmp(*speculative, 1)
 
-  line_col++;
+// point the lexer at p, the end is always the end of the source
+void start_lexing(const char *p) {
+  cursor = p;
+  buf_end = source->buf + source->len;
+  cur_char = p > source->buf ? p[-1] : '\n';
+  next_char = cursor < buf_end ? *cursor : EOF;
+}
+
+// setup global so that read_char can be called
+void setup_lexer() {
+  setup_scanner();
+  setup_tables();
+  setup_preprocessor();
+  push_input(source);
+  lex_tokens();
+}
 
+// location of a char in the current source
+unsigned int char_loc(const char *p) {
+  return source->base + (p - source->buf);
+}
+
+char read_char() {
   // character really should be ascii
   if (next_char < -1) {
+    BAIL_IF_SPECULATIVE;
     printf("Syntax error: found non-ascii character %c", cur_char);
+    fail_loc = char_loc(cursor);
     FAIL;
   }
 
   cur_char = next_char;
-  next_char = fgetc(stream);
+
+  if (cursor < buf_end)
+    cursor++;
+
+  next_char = cursor < buf_end ? *cursor : EOF;
   return cur_char;
 }
 
+// move the cursor forward to p
+// cur_char becomes the char before p
+void skip_to(const char *p) {
+  if (p == cursor) {
+    return;
+  }
+
+  cursor = p;
+  cur_char = p[-1];
+  next_char = cursor < buf_end ? *cursor : EOF;
+}
+
+// skip whitespace and comments before the next token
+void skip_space() {
+  const char *p = cursor;
+
+  while (1) {
+    p = scan.space(p, buf_end);
+
+    if (buf_end - p < 2) {
+      break;
+    }
+
+    if (p[0] == '\\' && (p[1] == '\n' || p[1] == '\r')) {
+      // a backslash at the end of a line joins it to the next one
+      p += p[1] == '\r' && buf_end - p > 2 && p[2] == '\n' ? 3 : 2;
+    } else if (p[0] != '/') {
+      break;
+    } else if (p[1] == '/') {
+      // comment - ignore until newline
+      p = scan.line_end(p + 2, buf_end);
+    } else if (p[1] == '*') {
+      const char *end = scan.comment_end(p + 2, buf_end);
+
+      if (end == buf_end) {
+        BAIL_IF_SPECULATIVE;
+        printf("Syntax error: unterminated comment\n");
+        fail_loc = char_loc(p);
+        FAIL;
+      }
+
+      p = end + 2;
+    } else {
+      break;
+    }
+  }
+
+  skip_to(p);
+}
+
 void eat_char(char c) {
   if (cur_char != c) {
+    BAIL_IF_SPECULATIVE;
     printf("Syntax error: expected char '%c', found '%c'\n", c, cur_char);
+    fail_loc = char_loc(cursor - 1);
     FAIL;
   }
 
   read_char();
 }
 
-char lexeme[256];
+// last lexeme read, points into the source buffer
+_Thread_local const char *lexeme;
 
 // read consecutive alpha-numeric
-void read_lexeme() {
+// returns length of lexeme
+int read_lexeme() {
   // special character
-  if (!isalnum(cur_char) && cur_char != '_') {
+  if (CLASS(cur_char) != CC_ALPHA && CLASS(cur_char) != CC_DIGIT) {
+    BAIL_IF_SPECULATIVE;
     printf("Compiler error: Tried to read lexeme from character '%c'\n",
            cur_char);
+    fail_loc = char_loc(cursor - 1);
     FAIL;
   }
 
-  memset(lexeme, 0, 256);
-  lexeme[0] = cur_char;
-  int len = 1;
+  // lexeme starts at cur_char
+  const char *p = scan.ident(cursor, buf_end);
+  lexeme = cursor - 1;
 
-  while (isalnum(next_char) || next_char == '_') {
-    lexeme[len++] = read_char();
-  }
+  skip_to(p);
+
+  return p - lexeme;
 }
 
-struct Token cur_token;
+// thread local so that function bodies can be parsed in parallel
+_Thread_local struct Token cur_token;
+
+// location and flags of the token being lexed
+_Thread_local unsigned int token_loc;
+_Thread_local unsigned short token_flags;
+
+// workers can't use the interner, identifiers are left as slices of the
+// source and interned in order once the chunks are joined
+_Thread_local int defer_intern = 0;
 
 struct Token new_tok(enum TokenKind kind) {
-  return (struct Token){.kind = kind};
+  return (struct Token){.kind = kind, .flags = token_flags, .loc = token_loc};
 }
 
-// characters that are easy to map
-// unspecified characters are 0
-enum TokenKind char_map[127] = {
-    ['('] = L_PAREN, [')'] = R_PAREN, ['['] = L_SQUARE, [']'] = R_SQUARE,
-    ['{'] = L_BRACE, ['}'] = R_BRACE, ['*'] = STAR,     ['+'] = PLUS,
-    ['%'] = MOD,     [','] = COMMA,   ['.'] = DOT,      [';'] = SEMICOLON,
-    [':'] = COLON,   ['&'] = AMP,     ['-'] = MINUS,
+// spelling of every C89 punctuator
+// the punctuator dfa is generated from these
+char *punctuators[256] = {
+    [L_PAREN] = "(",     [R_PAREN] = ")",     [L_SQUARE] = "[",
+    [R_SQUARE] = "]",    [L_BRACE] = "{",     [R_BRACE] = "}",
+    [DOT] = ".",         [ARROW] = "->",      [ELLIPSIS] = "...",
+    [COMMA] = ",",       [SEMICOLON] = ";",   [COLON] = ":",
+    [QUESTION] = "?",    [ASSIGN] = "=",      [EQ] = "==",
+    [NOT] = "!",         [NE] = "!=",         [LT] = "<",
+    [LTE] = "<=",        [SHL] = "<<",        [SHL_ASSIGN] = "<<=",
+    [GT] = ">",          [GTE] = ">=",        [SHR] = ">>",
+    [SHR_ASSIGN] = ">>=", [PLUS] = "+",       [INC] = "++",
+    [ADD_ASSIGN] = "+=", [MINUS] = "-",       [DEC] = "--",
+    [SUB_ASSIGN] = "-=", [STAR] = "*",        [MUL_ASSIGN] = "*=",
+    [SLASH] = "/",       [DIV_ASSIGN] = "/=", [MOD] = "%",
+    [MOD_ASSIGN] = "%=", [AMP] = "&",         [AND] = "&&",
+    [AND_ASSIGN] = "&=", [PIPE] = "|",        [OR] = "||",
+    [OR_ASSIGN] = "|=",  [CARET] = "^",       [XOR_ASSIGN] = "^=",
+    [TILDE] = "~",       [HASH] = "#",        [HASH_HASH] = "##",
 };
 
-// mappings from keywords to tokens
+#define DFA_STATES 64
+
+// punctuator dfa
+// state 0 is the start state, a transition to state 0 means no transition
+// dfa_accept[state] is the token for the punctuator spelled on the way to
+// state, or 0 if that is only a prefix of a punctuator (like "..")
+unsigned char dfa[DFA_STATES][N_CHAR_CLASSES];
+enum TokenKind dfa_accept[DFA_STATES];
+
+// finish the char class table and build the dfa as a trie of the
+// punctuator spellings
+void setup_tables() {
+  for (int c = 'a'; c <= 'z'; c++) {
+    char_class[c] = CC_ALPHA;
+    char_class[c - 'a' + 'A'] = CC_ALPHA;
+  }
+
+  for (int c = '0'; c <= '9'; c++) {
+    char_class[c] = CC_DIGIT;
+  }
+
+  int n_states = 1;
+
+  for (int kind = 0; kind < 256; kind++) {
+    char *spelling = punctuators[kind];
+
+    if (spelling == NULL) {
+      continue;
+    }
+
+    int state = 0;
+
+    for (; *spelling; spelling++) {
+      unsigned char *next = &dfa[state][CLASS(*spelling)];
+
+      if (*next == 0) {
+        *next = n_states++;
+      }
+
+      state = *next;
+    }
+
+    dfa_accept[state] = kind;
+  }
+}
+
+// perfect hash of a keyword from its length, first and last char
+// every C89 keyword gets its own slot so a lookup is one probe
+// two keywords hashing to the same slot is caught by -Woverride-init
+#define KW_HASH(len, first, last) ((5 * ((len) + (last)) + 14 * (first)) & 63)
+
+// mappings from keywords to tokens, indexed by KW_HASH
 struct {
   enum TokenKind token;
   char *keyword;
-} keywords[] = {
-    {ELSE, "else"},        {FOR, "for"},        {WHILE, "while"},
-    {STRUCT, "struct"},    {ENUM, "enum"},      {UNION, "union"},
-    {TYPEDEF, "typedef"},  {RETURN, "return"},  {INT_TYPE, "int"},
-    {FLOAT_TYPE, "float"}, {VOID_TYPE, "void"}, {CHAR_TYPE, "char"},
+  int len;
+} keywords[64] = {
+    [KW_HASH(4, 'a', 'o')] = {AUTO, "auto", 4},
+    [KW_HASH(5, 'b', 'k')] = {BREAK, "break", 5},
+    [KW_HASH(4, 'c', 'e')] = {CASE, "case", 4},
+    [KW_HASH(4, 'c', 'r')] = {CHAR_TYPE, "char", 4},
+    [KW_HASH(5, 'c', 't')] = {CONST, "const", 5},
+    [KW_HASH(8, 'c', 'e')] = {CONTINUE, "continue", 8},
+    [KW_HASH(7, 'd', 't')] = {DEFAULT, "default", 7},
+    [KW_HASH(2, 'd', 'o')] = {DO, "do", 2},
+    [KW_HASH(6, 'd', 'e')] = {DOUBLE_TYPE, "double", 6},
+    [KW_HASH(4, 'e', 'e')] = {ELSE, "else", 4},
+    [KW_HASH(4, 'e', 'm')] = {ENUM, "enum", 4},
+    [KW_HASH(6, 'e', 'n')] = {EXTERN, "extern", 6},
+    [KW_HASH(5, 'f', 't')] = {FLOAT_TYPE, "float", 5},
+    [KW_HASH(3, 'f', 'r')] = {FOR, "for", 3},
+    [KW_HASH(4, 'g', 'o')] = {GOTO, "goto", 4},
+    [KW_HASH(2, 'i', 'f')] = {IF, "if", 2},
+    [KW_HASH(3, 'i', 't')] = {INT_TYPE, "int", 3},
+    [KW_HASH(4, 'l', 'g')] = {LONG_TYPE, "long", 4},
+    [KW_HASH(8, 'r', 'r')] = {REGISTER, "register", 8},
+    [KW_HASH(6, 'r', 'n')] = {RETURN, "return", 6},
+    [KW_HASH(5, 's', 't')] = {SHORT_TYPE, "short", 5},
+    [KW_HASH(6, 's', 'd')] = {SIGNED, "signed", 6},
+    [KW_HASH(6, 's', 'f')] = {SIZEOF, "sizeof", 6},
+    [KW_HASH(6, 's', 'c')] = {STATIC, "static", 6},
+    [KW_HASH(6, 's', 't')] = {STRUCT, "struct", 6},
+    [KW_HASH(6, 's', 'h')] = {SWITCH, "switch", 6},
+    [KW_HASH(7, 't', 'f')] = {TYPEDEF, "typedef", 7},
+    [KW_HASH(5, 'u', 'n')] = {UNION, "union", 5},
+    [KW_HASH(8, 'u', 'd')] = {UNSIGNED, "unsigned", 8},
+    [KW_HASH(4, 'v', 'd')] = {VOID_TYPE, "void", 4},
+    [KW_HASH(8, 'v', 'e')] = {VOLATILE, "volatile", 8},
+    [KW_HASH(5, 'w', 'e')] = {WHILE, "while", 5},
 };
 
+// returns keyword token for str, or IDENT if it isn't a keyword
+enum TokenKind lookup_keyword(const char *str, int len) {
+  int hash = KW_HASH(len, str[0], str[len - 1]);
+
+  if (keywords[hash].len == len && !memcmp(str, keywords[hash].keyword, len)) {
+    return keywords[hash].token;
+  }
+
+  return IDENT;
+}
+
+// match the longest punctuator starting at cur_char
+struct Token match_punctuator() {
+  const char *p = cursor - 1;
+  const char *token_end = NULL;
+  enum TokenKind kind = ERR;
+  int state = 0;
+
+  while (p < buf_end && (state = dfa[state][CLASS(*p)])) {
+    p++;
+
+    if (dfa_accept[state]) {
+      kind = dfa_accept[state];
+      token_end = p;
+    }
+  }
+
+  if (kind == ERR) {
+    BAIL_IF_SPECULATIVE;
+    printf("Couldn't match char '%c'\n", cur_char);
+    fail_loc = char_loc(cursor - 1);
+    FAIL;
+  }
+
+  skip_to(token_end);
+
+  return new_tok(kind);
+}
+
+int hex_digit(char c) {
+  if (CLASS(c) == CC_DIGIT) {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+
+  return -1;
+}
+
+void number_error(const char *p, const char *msg) {
+  BAIL_IF_SPECULATIVE;
+  printf("Syntax error: %s\n", msg);
+  fail_loc = char_loc(p);
+  FAIL;
+}
+
+// the literal must not run straight into an identifier or another number
+void check_number_end(const char *p, const char *end) {
+  if (p < end && (CLASS(*p) == CC_ALPHA || CLASS(*p) == CC_DIGIT ||
+                  *p == '.')) {
+    BAIL_IF_SPECULATIVE;
+    printf("Syntax error: unexpected character '%c' in numeric literal\n",
+           *p);
+    fail_loc = char_loc(p);
+    FAIL;
+  }
+}
+
+// integer suffixes and the C89 rules for the type of an integer literal
+const char *lex_int_suffix(const char *p, const char *end, int decimal,
+                           struct Token *token) {
+  int is_unsigned = 0, is_long = 0;
+
+  while (p < end) {
+    if ((*p == 'u' || *p == 'U') && !is_unsigned) {
+      is_unsigned = 1;
+    } else if ((*p == 'l' || *p == 'L') && !is_long) {
+      is_long = 1;
+    } else {
+      break;
+    }
+
+    p++;
+  }
+
+  check_number_end(p, end);
+
+  unsigned long value = token->int_literal;
+
+  // smallest type in int, unsigned int, long, unsigned long that fits
+  // unsigned types are skipped for unsuffixed decimals
+  if (!is_long && value <= (is_unsigned ? UINT_MAX : INT_MAX)) {
+    token->flags |= is_unsigned ? LIT_UNSIGNED : 0;
+  } else if (!is_long && !is_unsigned && !decimal && value <= UINT_MAX) {
+    token->flags |= LIT_UNSIGNED;
+  } else if (!is_unsigned && value <= LONG_MAX) {
+    token->flags |= LIT_LONG;
+  } else {
+    token->flags |= LIT_UNSIGNED | LIT_LONG;
+  }
+
+  return p;
+}
+
+// decimal digits that always fit in an unsigned long
+#if ULONG_MAX > 0xffffffffUL
+#define SAFE_DIGITS 19
+#else
+#define SAFE_DIGITS 9
+#endif
+
+// lex the numeric literal starting at p into token
+// returns the end of the literal
+// the digits are only walked once, the decimal, octal and floating values
+// are all accumulated together until it is clear which one the literal is
+const char *lex_number(const char *p, const char *end, struct Token *token) {
+  const char *start = p;
+  unsigned long value = 0;
+  int overflow = 0;
+
+  token->kind = INTEGER;
+
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    int d;
+    p += 2;
+
+    if (hex_digit(*p) < 0) {
+      number_error(p, "expected hex digit after 0x");
+    }
+
+    while (p < end && (d = hex_digit(*p)) >= 0) {
+      overflow |= value >> (sizeof(value) * CHAR_BIT - 4) != 0;
+      value = value << 4 | d;
+      p++;
+    }
+
+    if (overflow) {
+      number_error(start, "integer literal is too large");
+    }
+
+    token->int_literal = value;
+    return lex_int_suffix(p, end, 0, token);
+  }
+
+  unsigned long octal = 0;
+  int octal_overflow = 0;
+  const char *bad_octal = NULL;
+
+  // up to 19 significant digits are kept for floats, which always fits
+  unsigned long long mantissa = 0;
+  int n_digits = 0;
+  int exponent = 0;
+  int truncated = 0;
+
+  while (p < end && CLASS(*p) == CC_DIGIT) {
+    int d = *p - '0';
+
+    if (p - start >= SAFE_DIGITS) {
+      overflow |= value > (ULONG_MAX - d) / 10;
+    }
+
+    value = value * 10 + d;
+
+    octal_overflow |= octal >> (sizeof(octal) * CHAR_BIT - 3) != 0;
+    octal = octal << 3 | d;
+
+    if (d >= 8 && !bad_octal) {
+      bad_octal = p;
+    }
+
+    if (n_digits < 19) {
+      mantissa = mantissa * 10 + d;
+      n_digits += mantissa != 0;
+    } else {
+      exponent++;
+      truncated |= d;
+    }
+
+    p++;
+  }
+
+  if (p == end || (*p != '.' && *p != 'e' && *p != 'E')) {
+    if (start[0] == '0') {
+      if (bad_octal) {
+        number_error(bad_octal, "invalid digit in octal literal");
+      }
+
+      overflow = octal_overflow;
+      value = octal;
+    }
+
+    if (overflow) {
+      number_error(start, "integer literal is too large");
+    }
+
+    token->int_literal = value;
+    return lex_int_suffix(p, end, start[0] != '0', token);
+  }
+
+  token->kind = FLOAT;
+
+  if (*p == '.') {
+    p++;
+
+    while (p < end && CLASS(*p) == CC_DIGIT) {
+      int d = *p - '0';
+
+      if (n_digits < 19) {
+        mantissa = mantissa * 10 + d;
+        n_digits += mantissa != 0;
+        exponent--;
+      } else {
+        truncated |= d;
+      }
+
+      p++;
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    int negative = 0, e = 0;
+    p++;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+      negative = *p++ == '-';
+    }
+
+    if (p == end || CLASS(*p) != CC_DIGIT) {
+      number_error(p, "expected digits in exponent");
+    }
+
+    while (p < end && CLASS(*p) == CC_DIGIT) {
+      // anything this big is 0 or inf anyway
+      if (e < 100000) {
+        e = e * 10 + (*p - '0');
+      }
+
+      p++;
+    }
+
+    exponent += negative ? -e : e;
+  }
+
+  double d = decimal_to_double(mantissa, exponent, truncated, start, p - start);
+
+  if (p < end && (*p == 'f' || *p == 'F')) {
+    // rounded twice, can be off by one in the last place for float
+    d = (float)d;
+    token->flags |= LIT_FLOAT;
+    p++;
+  } else if (p < end && (*p == 'l' || *p == 'L')) {
+    token->flags |= LIT_LONG;
+    p++;
+  }
+
+  check_number_end(p, end);
+
+  token->float_literal = d;
+  return p;
+}
+
+// whether there is a line break between prev_end and p
+// newlines after a backslash are continuations and don't count
+int starts_line(const char *prev_end, const char *p) {
+  if (prev_end == source->buf) {
+    return 1;
+  }
+
+  for (const char *q = prev_end - 1; (q = memchr(q, '\n', p - q)); q++) {
+    const char *end = q > source->buf && q[-1] == '\r' ? q - 1 : q;
+
+    if (end == source->buf || end[-1] != '\\') {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// report an error in a character literal at loc
+void char_error(unsigned int loc, const char *msg) {
+  BAIL_IF_SPECULATIVE;
+  printf("Syntax error: %s\n", msg);
+  fail_loc = loc;
+  FAIL;
+}
+
+// value of the char in a character literal, the opening quote has been read
+char lex_char() {
+  char c = read_char();
+
+  if (c == '\'') {
+    char_error(char_loc(cursor - 1), "empty character literal");
+  } else if (c == '\n' || c == EOF) {
+    char_error(char_loc(cursor - 1), "unterminated character literal");
+  }
+
+  if (c != '\\') {
+    return c;
+  }
+
+  c = read_char();
+
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'v':
+    return '\v';
+  case 'b':
+    return '\b';
+  case 'r':
+    return '\r';
+  case 'f':
+    return '\f';
+  case 'a':
+    return '\a';
+  case '\\':
+  case '?':
+  case '\'':
+  case '"':
+    return c;
+  case 'x':;
+    int value = 0, digits = 0;
+
+    while (hex_digit(next_char) >= 0) {
+      value = value * 16 + hex_digit(read_char());
+      digits++;
+    }
+
+    if (digits == 0) {
+      char_error(char_loc(cursor - 1), "\\x with no hex digits");
+    }
+
+    return value;
+  default:
+    // up to three octal digits
+    if (c >= '0' && c <= '7') {
+      int value = c - '0';
+
+      for (int i = 1; i < 3 && next_char >= '0' && next_char <= '7'; i++) {
+        value = value * 8 + read_char() - '0';
+      }
+
+      return value;
+    }
+
+    char_error(char_loc(cursor - 1), "unknown escape sequence");
+    return 0;
+  }
+}
+
 // get next token
 struct Token get_token() {
-  read_char();
+  const char *prev_end = cursor;
+
+  skip_space();
+
+  // the preprocessor needs to know where lines start and, for macro
+  // definitions and stringizing, where there was space between tokens
+  token_flags = cursor != prev_end ? TOK_SPACE : 0;
 
-  while (isspace(cur_char)) {
-    read_char();
+  if (starts_line(prev_end, cursor)) {
+    token_flags |= TOK_BOL;
   }
 
-  if (char_map[(int)cur_char] != 0) {
-    return new_tok(char_map[(int)cur_char]);
+  read_char();
+  token_loc = char_loc(cursor - 1);
+
+  if (cur_char == EOF && cursor == buf_end) {
+    return new_tok(END);
   }
 
   // check what lexeme is and emit token
-  if (isdigit(cur_char)) {
-    read_lexeme();
+  switch (CLASS(cur_char)) {
+  case CC_DIGIT:;
+    struct Token token = new_tok(INTEGER);
+    skip_to(lex_number(cursor - 1, buf_end, &token));
+    return token;
+
+  case CC_ALPHA:;
+    int len = read_lexeme();
 
-    // TODO: float
+    // keyword or identifier
+    enum TokenKind kind = lookup_keyword(lexeme, len);
+
+    if (kind != IDENT) {
+      return new_tok(kind);
+    }
 
-    for (int i = 1; lexeme[i] != '\0'; i++) {
-      if (!isdigit(lexeme[i])) {
-        printf("Syntax error: unexpected character '%c' in int literal %s\n",
-               lexeme[i], lexeme);
+    token = new_tok(IDENT);
+
+    if (defer_intern) {
+      token.str_literal.loc = char_loc(lexeme);
+      token.str_literal.len = len;
+    } else {
+      token.ident = intern(lexeme, len);
+    }
+
+    return token;
+
+  case CC_QUOTE:
+    token = new_tok(CHAR);
+    token.char_literal = lex_char();
+
+    if (read_char() != '\'') {
+      char_error(token.loc, "unterminated character literal");
+    }
+
+    return token;
+
+  case CC_DQUOTE:;
+    // literal is kept as a slice of the source
+    token = new_tok(STRING);
+    token.str_literal.loc = char_loc(cursor);
+
+    const char *p = cursor;
+
+    while (1) {
+      p = scan.string_end(p, buf_end);
+
+      if (p >= buf_end || *p == '\n') {
+        BAIL_IF_SPECULATIVE;
+        printf("Syntax error: unterminated string literal\n");
+        fail_loc = token.loc;
         FAIL;
       }
+
+      if (*p == '"') {
+        break;
+      }
+
+      // escaped char, TODO: handle escaped characters properly
+      p += 2;
     }
 
-    struct Token token = new_tok(INTEGER);
-    token.int_literal = atoi(lexeme);
+    token.str_literal.len = char_loc(p) - token.str_literal.loc;
+    skip_to(p + 1);
 
     return token;
-  } else if (isalpha(cur_char) || cur_char == '_') {
-    read_lexeme();
 
-    // keyword or identifier
+  case CC_DOT:
+    // floating literal like .5
+    if (CLASS(next_char) == CC_DIGIT) {
+      token = new_tok(FLOAT);
+      skip_to(lex_number(cursor - 1, buf_end, &token));
+      return token;
+    }
+
+    return match_punctuator();
+
+  default:
+    // comments have already been skipped so '/' is always a punctuator
+    return match_punctuator();
+  }
+}
+
+// growable array of tokens
+struct TokenList {
+  struct Token *tokens;
+  int len;
+  int cap;
+};
+
+void push_token(struct TokenList *list, struct Token token) {
+  if (list->len == list->cap) {
+    list->cap = list->cap ? list->cap * 2 : 1024;
+    list->tokens = realloc(list->tokens, list->cap * sizeof(*list->tokens));
+  }
+
+  list->tokens[list->len++] = token;
+}
+
+// big sources are split into chunks at newlines and lexed up front in
+// parallel, each worker assumes its chunk doesn't start inside a comment
+// the chunks are then joined in order and lexed again serially where that
+// was wrong
+#define MIN_CHUNK_SIZE (1 << 20)
+#define MAX_CHUNKS 64
+
+int lex_chunks = 0;
+
+struct Chunk {
+  const char *start;
+  const char *end;
+
+  // tokens starting in the chunk, then the first token after it
+  // if the worker hit an error the tokens are unusable
+  struct Token *tokens;
+  int n_tokens;
+  int cap;
+  int failed;
+
+  pthread_t thread;
+  int joined;
+};
+
+void *lex_chunk(void *arg) {
+  struct Chunk *chunk = arg;
+  unsigned int end_loc = char_loc(chunk->end);
+  jmp_buf bail;
+
+  chunk->cap = (chunk->end - chunk->start) / 4 + 16;
+  chunk->tokens = malloc(chunk->cap * sizeof(*chunk->tokens));
+  chunk->n_tokens = 0;
+  chunk->failed = 0;
+
+  if (setjmp(bail)) {
+    chunk->failed = 1;
+    return NULL;
+  }
+
+  speculative = &bail;
+  defer_intern = 1;
+  start_lexing(chunk->start);
+
+  struct Token token;
+
+  do {
+    if (chunk->n_tokens == chunk->cap) {
+      chunk->cap *= 2;
+      chunk->tokens =
+          realloc(chunk->tokens, chunk->cap * sizeof(*chunk->tokens));
+    }
+
+    token = get_token();
+    chunk->tokens[chunk->n_tokens++] = token;
+  } while (token.kind != END && token.loc < end_loc);
+
+  return NULL;
+}
+
+// identifiers from workers are interned once they are known to be in order
+struct Token intern_deferred(struct Token token) {
+  if (token.kind == IDENT) {
+    const char *name = loc_ptr(token.str_literal.loc);
+    token.ident = intern(name, token.str_literal.len);
+    token.hide_set = 0;
+  }
+
+  return token;
+}
 
-    for (int i = 0; i < (int)(sizeof(keywords) / sizeof(keywords[0])); i++) {
-      if (!strcmp(lexeme, keywords[i].keyword)) {
-        return new_tok(keywords[i].token);
+// lex serially from the current position, pushing tokens until one starts
+// at or after end which is returned without being pushed
+// once a token lines up with one of chunk's the rest of the chunk is right
+// as lexing from a token start doesn't depend on anything before it
+// apart from the flags, so if lexing starts at token first its flags are
+// kept
+struct Token lex_serial_until(struct TokenList *list, const char *end,
+                              struct Chunk *chunk, struct Token *first) {
+  unsigned int end_loc = char_loc(end);
+  int n_chunk = chunk && !chunk->failed ? chunk->n_tokens - 1 : 0;
+  int j = 0;
+
+  while (1) {
+    struct Token token = get_token();
+
+    if (first) {
+      token.flags = first->flags;
+      first = NULL;
+    }
+
+    if (token.kind == END || token.loc >= end_loc) {
+      return token;
+    }
+
+    push_token(list, token);
+
+    while (j < n_chunk && chunk->tokens[j].loc < token.loc) {
+      j++;
+    }
+
+    if (j < n_chunk && chunk->tokens[j].loc == token.loc) {
+      for (j++; j < n_chunk; j++) {
+        push_token(list, intern_deferred(chunk->tokens[j]));
       }
+
+      return intern_deferred(chunk->tokens[n_chunk]);
     }
+  }
+}
 
-    // didn't match any keywords
-    struct Token token = new_tok(IDENT);
-    strcpy(token.identifier, lexeme);
-    return token;
-  } else if (cur_char == '/') {
-    if (next_char == '/') {
-      // comment - ignore until newline
-      // TODO: multiline comments
+// the whole file is lexed into list
+// returns 0 if there was an error, which may be in code the preprocessor
+// skips so the file is lexed as needed instead to find out
+int lex_parallel(struct TokenList *list, int n_chunks) {
+  // not a local array, it has to survive the longjmp
+  struct Chunk *chunks = calloc(n_chunks, sizeof(*chunks));
+  const char *buf = source->buf;
+  const char *end = buf + source->len;
+  jmp_buf bail;
+
+  for (int i = 0; i < n_chunks; i++) {
+    chunks[i].start = i == 0 ? buf : chunks[i - 1].end;
+    chunks[i].end = end;
+
+    if (i < n_chunks - 1) {
+      const char *split = buf + source->len / n_chunks * (i + 1);
 
-      while (cur_char != '\n') {
-        read_char();
+      if (split < chunks[i].start) {
+        split = chunks[i].start;
       }
 
-      return get_token();
-    } else {
-      return new_tok(SLASH);
+      const char *newline = memchr(split, '\n', end - split);
+
+      // don't split inside a continued line
+      while (newline && newline > buf && newline[-1] == '\\') {
+        newline = memchr(newline + 1, '\n', end - newline - 1);
+      }
+      chunks[i].end = newline ? newline + 1 : end;
     }
-  } else if (cur_char == '#') {
-    // TODO: handle preprocessing at this stage
-    // just ignore macros
-    // preprocessing should only happen on newlines starting with #
 
-    while (cur_char != '\n') {
-      read_char();
+    if (i > 0) {
+      pthread_create(&chunks[i].thread, NULL, lex_chunk, &chunks[i]);
     }
+  }
+
+  if (setjmp(bail)) {
+    speculative = NULL;
 
-    return get_token();
+    for (int i = 1; i < n_chunks; i++) {
+      if (!chunks[i].joined) {
+        pthread_join(chunks[i].thread, NULL);
+        free(chunks[i].tokens);
+      }
+    }
 
-    // will work smth like this
-    eat_char('#');
-    read_lexeme();
+    free(chunks);
+    return 0;
+  }
 
-    if (!strcmp(lexeme, "include")) {
-      // switch input stream to new file
-      // start reading from new file
-    } else {
-      // defines, ifdef etc.
+  speculative = &bail;
+
+  // the first chunk is lexed here and is always right
+  start_lexing(buf);
+  struct Token next = lex_serial_until(list, chunks[0].end, NULL, NULL);
+
+  // next is the first token not pushed yet, lex from it to join each chunk
+  for (int i = 1; i < n_chunks; i++) {
+    pthread_join(chunks[i].thread, NULL);
+
+    if (next.kind != END) {
+      start_lexing(buf + (next.loc - source->base));
+      next = lex_serial_until(list, chunks[i].end, &chunks[i], &next);
     }
-  } else if (cur_char == '\'') {
-    if (read_char() == '\\') {
-      // TODO: handle properly
-      // \n \t \v \b \r \f \a \\ \? \' \" \xhh
-      eat_char('\\');
+
+    chunks[i].joined = 1;
+    free(chunks[i].tokens);
+  }
+
+  speculative = NULL;
+  free(chunks);
+  push_token(list, next);
+  return 1;
+}
+
+// an input on the include stack
+struct Input {
+  struct Source *source;
+  const char *cursor; // where to carry on from once it is on top again
+
+  // tokens of a big file lexed up front, NULL if lexed as needed
+  struct Token *tokens;
+  int n_tokens;
+  int pos;
+};
+
+struct Input inputs[MAX_INPUTS];
+int n_inputs = 0;
+
+void push_input(struct Source *src) {
+  if (n_inputs == MAX_INPUTS) {
+    printf("Error: #include nested too deeply\n");
+    FAIL;
+  }
+
+  if (n_inputs > 0) {
+    inputs[n_inputs - 1].cursor = cursor;
+  }
+
+  struct Input *input = &inputs[n_inputs++];
+  *input = (struct Input){.source = src};
+  source = src;
+
+  int n_chunks = lex_chunks;
+
+  if (n_chunks == 0) {
+    n_chunks = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n_chunks > source->len / MIN_CHUNK_SIZE) {
+      n_chunks = source->len / MIN_CHUNK_SIZE;
     }
+  }
 
-    struct Token token = new_tok(CHAR);
-    token.str_literal[0] = read_char();
+  if (n_chunks > MAX_CHUNKS) {
+    n_chunks = MAX_CHUNKS;
+  }
 
-    return token;
-  } else if (cur_char == '\"') {
-    struct Token token = new_tok(STRING);
-    int len = 0;
+  if (n_chunks > 1) {
+    struct TokenList list = {NULL, 0, 0};
 
-    while (read_char() != '\"') {
-      // TODO: handle escaped characters properly
+    if (lex_parallel(&list, n_chunks)) {
+      input->tokens = list.tokens;
+      input->n_tokens = list.len;
+    } else {
+      free(list.tokens);
+    }
+  }
 
-      token.str_literal[len++] = cur_char;
+  start_lexing(source->buf);
+}
+
+void pop_input() {
+  free(inputs[--n_inputs].tokens);
+
+  source = inputs[n_inputs - 1].source;
+  start_lexing(inputs[n_inputs - 1].cursor);
+}
+
+int input_depth() { return n_inputs; }
+
+struct Token lex_token() {
+  struct Input *input = &inputs[n_inputs - 1];
+
+  if (input->tokens) {
+    struct Token token = input->tokens[input->pos];
+
+    if (token.kind != END) {
+      input->pos++;
     }
 
     return token;
-  } else if (cur_char == '=') {
-    if (next_char == '=') {
-      eat_char('=');
-      return new_tok(EQ);
-    } else {
-      return new_tok(ASSIGN);
+  }
+
+  return get_token();
+}
+
+struct Token lex_directive_token() {
+  struct Input *input = &inputs[n_inputs - 1];
+  struct Token token;
+
+  if (input->tokens) {
+    token = input->tokens[input->pos];
+
+    if (!(token.flags & TOK_BOL) && token.kind != END) {
+      input->pos++;
+      return token;
     }
-  } else if (cur_char == '<') {
-    if (next_char == '=') {
-      eat_char('<');
-      return new_tok(LTE);
-    } else {
-      return new_tok(LT);
+  } else {
+    const char *before = cursor;
+    token = get_token();
+
+    if (!(token.flags & TOK_BOL) && token.kind != END) {
+      return token;
     }
-  } else if (cur_char == '>') {
-    if (next_char == '=') {
-      eat_char('>');
-      return new_tok(GTE);
-    } else {
-      return new_tok(GT);
+
+    // leave the token for the next line
+    start_lexing(before);
+  }
+
+  return (struct Token){.kind = EOD, .loc = token.loc};
+}
+
+// skip the rest of the line at p and return the start of the next one
+// comments, literals and continued lines are followed, so a newline or #
+// inside them isn't taken for the start of a line
+const char *skip_line(const char *p) {
+  while (1) {
+    p = scan.skipped(p, buf_end);
+
+    if (p == buf_end) {
+      return p;
     }
-  } else if (cur_char == '!') {
-    if (next_char == '=') {
-      eat_char('!');
-      return new_tok(NE);
-    } else {
-      return new_tok(NOT);
+
+    switch (*p++) {
+    case '\n':
+      return p;
+
+    case '\\':
+      // continued line or escaped char
+      if (p < buf_end) {
+        p++;
+      }
+      break;
+
+    case '/':
+      if (p < buf_end && *p == '/') {
+        p = scan.line_end(p, buf_end);
+      } else if (p < buf_end && *p == '*') {
+        const char *end = scan.comment_end(p + 1, buf_end);
+        p = end == buf_end ? end : end + 2;
+      }
+      break;
+
+    default:;
+      // literals can't span lines, an unterminated one ends at the newline
+      char quote = p[-1];
+
+      while (p < buf_end && *p != quote && *p != '\n') {
+        p += *p == '\\' && p + 1 < buf_end ? 2 : 1;
+      }
+
+      if (p < buf_end && *p == quote) {
+        p++;
+      }
+      break;
     }
-  } else if (cur_char == EOF) {
-    return new_tok(END);
   }
+}
 
-  printf("Couldn't match char '%c'\n", cur_char);
-  FAIL;
-  return new_tok(ERR);
+void skip_inactive() {
+  struct Input *input = &inputs[n_inputs - 1];
+
+  if (input->tokens) {
+    struct Token *tokens = input->tokens;
+
+    while (tokens[input->pos].kind != END &&
+           !(tokens[input->pos].kind == HASH &&
+             tokens[input->pos].flags & TOK_BOL)) {
+      input->pos++;
+    }
+
+    return;
+  }
+
+  const char *line = skip_line(cursor);
+
+  while (line < buf_end) {
+    const char *p = scan.space(line, buf_end);
+
+    // comments before the # are fine as long as the line doesn't end in one
+    while (buf_end - p >= 2 && p[0] == '/' && p[1] == '*') {
+      const char *end = scan.comment_end(p + 2, buf_end);
+
+      if (end == buf_end || memchr(p, '\n', end - p)) {
+        break;
+      }
+
+      p = scan.space(end + 2, buf_end);
+    }
+
+    if (p < buf_end && *p == '#') {
+      break;
+    }
+
+    line = skip_line(p);
+  }
+
+  start_lexing(line);
 }
 
-struct Token read_token() { return cur_token = get_token(); }
+// lex the single token at loc, sets *len to its length
+// used by the preprocessor to spell and paste tokens
+struct Token lex_at(unsigned int loc, int *len) {
+  struct Source *saved_source = source;
+  const char *saved_cursor = cursor;
+
+  source = loc_source(loc);
+  const char *p = loc_ptr(loc);
+  start_lexing(p);
+
+  struct Token token = get_token();
+  *len = token.loc == loc ? cursor - p : 0;
+
+  source = saved_source;
+  start_lexing(saved_cursor);
+
+  return token;
+}
+
+// after preprocessing the whole translation unit is in one array
+// the parser walks it with a cursor so it can look ahead and backtrack
+struct Token *tokens = NULL;
+int n_tokens = 0;
+_Thread_local int token_pos = 0; // index of cur_token
+
+void lex_tokens() {
+  struct TokenList list = {NULL, 0, 0};
+  struct Token token;
+
+  do {
+    token = preprocess_token();
+    push_token(&list, token);
+  } while (token.kind != END);
+
+  tokens = list.tokens;
+  n_tokens = list.len;
+  token_pos = 0;
+  cur_token = tokens[0];
+}
+
+// move to the next token, stays on END once it is reached
+struct Token read_token() {
+  if (token_pos < n_tokens - 1) {
+    token_pos++;
+  }
+
+  return cur_token = tokens[token_pos];
+}
+
+// token n places after cur_token, peek_token(0) is cur_token
+struct Token peek_token(int n) {
+  if (token_pos + n >= n_tokens) {
+    return tokens[n_tokens - 1];
+  }
+
+  return tokens[token_pos + n];
+}
+
+// save position to backtrack to with restore_tokens
+int save_tokens() { return token_pos; }
+
+void restore_tokens(int pos) {
+  token_pos = pos;
+  cur_token = tokens[pos];
+}
 
 void eat_token(enum TokenKind kind) {
   if (cur_token.kind != kind) {
-    printf("Tried to match token '%s', found '%s'\n", token_repr[kind],
-           token_repr[cur_token.kind]);
+    error_printf("Tried to match token '%s', found '%s'\n", token_repr[kind],
+                 token_repr[cur_token.kind]);
     FAIL;
   }
 
@@ -1,8 +1,6 @@
 #ifndef LEXER_HEADER
 #define LEXER_HEADER
 
-#include <stdio.h>
-
 enum TokenKind {
   // brackets
   L_PAREN = '(',
@@ -13,47 +11,61 @@ enum TokenKind {
   R_SQUARE = ']',
 
   // separators
-  // TODO: ->
   ASSIGN = '=', // single =
   COMMA = ',',
   DOT = '.',
   SEMICOLON = ';',
   COLON = ':',
+  QUESTION = '?',
 
   // identifier
   IDENT = 128, // 128 to prevent collisions with chars
 
   // literals
-  // TODO: float
   INTEGER,
+  FLOAT,
   STRING,
   CHAR,
 
   // keywords
-  // TODO: switch/case/default do/while continue sizeof goto
-  // TODO: auto static const volatile signed unsigned extern register
   IF,
   ELSE,
   FOR,
   WHILE,
+  DO,
+  SWITCH,
+  CASE,
+  DEFAULT,
   RETURN,
   BREAK,
+  CONTINUE,
+  GOTO,
+  SIZEOF,
   STRUCT,
   UNION,
   ENUM,
   TYPEDEF,
 
+  // storage classes and qualifiers
+  AUTO,
+  STATIC,
+  EXTERN,
+  REGISTER,
+  CONST,
+  VOLATILE,
+  SIGNED,
+  UNSIGNED,
+
   // type keywords
-  // TODO: short/long/double
   INT_TYPE,
   CHAR_TYPE,
   FLOAT_TYPE,
   VOID_TYPE,
+  SHORT_TYPE,
+  LONG_TYPE,
+  DOUBLE_TYPE,
 
   // operators
-  // TODO: & | ^ << >>
-  // TODO: ++ --
-  // TODO: += -= etc
   AMP,  // & can be addressof or bitwise and
   STAR, // * can be multiply or pointer type or dereference
   SLASH,
@@ -69,6 +81,38 @@ enum TokenKind {
   NOT,
   OR,
   AND,
+  PIPE,     // |
+  CARET,    // ^
+  TILDE,    // ~
+  SHL,      // <<
+  SHR,      // >>
+  INC,      // ++
+  DEC,      // --
+  ARROW,    // ->
+  ELLIPSIS, // ...
+
+  // compound assignment
+  ADD_ASSIGN, // +=
+  SUB_ASSIGN, // -=
+  MUL_ASSIGN, // *=
+  DIV_ASSIGN, // /=
+  MOD_ASSIGN, // %=
+  AND_ASSIGN, // &=
+  OR_ASSIGN,  // |=
+  XOR_ASSIGN, // ^=
+  SHL_ASSIGN, // <<=
+  SHR_ASSIGN, // >>=
+
+  // # and ## outside of directives, used in macro definitions
+  HASH,
+  HASH_HASH,
+
+  // end of a preprocessing directive, see lex_directive_token
+  EOD,
+
+  // only in macro bodies, see preprocessor.c
+  PARAM,
+  PLACEMARKER,
 
   // handling
   ERR,
@@ -78,21 +122,80 @@ enum TokenKind {
 
 extern char *token_repr[256];
 
-extern FILE *stream; // current stream
+extern struct Source *source; // current source
+
+// token flags
+#define TOK_BOL 1   // first token on its line
+#define TOK_SPACE 2 // whitespace or a comment comes before the token
+
+// flags for numeric literals, the type the literal ends up with
+// INTEGER: unsigned and/or long, FLOAT: float (f suffix) or long double
+#define LIT_UNSIGNED 4
+#define LIT_LONG 8
+#define LIT_FLOAT 16
 
-extern struct Token {
-  enum TokenKind kind;
+extern _Thread_local struct Token {
+  unsigned short kind; // enum TokenKind, short to leave room for flags
+  unsigned short flags;
+  unsigned int loc; // source location, see source.h
   union {
-    char identifier[256];  // string name of identifier
-    char str_literal[256]; // value of string literal
-    int int_literal;       // value of numeric literal
+    // identifiers and punctuators
+    struct {
+      unsigned int ident;    // interned name of identifier
+      unsigned int hide_set; // macros that can't expand it, see preprocessor.c
+    };
+
+    unsigned long int_literal; // value of integer literal
+    double float_literal;      // value of floating literal
+    char char_literal;         // value of char literal
+
+    // string literal as a slice of the source, loc is the first char
+    // after the quote
+    struct {
+      unsigned int loc;
+      unsigned int len;
+    } str_literal;
   };
 } cur_token;
 
 void setup_lexer();
 
+// chunks each source is lexed in, whatever its size, for testing
+// 0 splits big sources into a chunk per processor, see lex_parallel
+extern int lex_chunks;
+
+// sources being lexed, an #include pushes the included file and it is
+// popped once the preprocessor sees its END
+#define MAX_INPUTS 200
+
+void push_input(struct Source *source);
+void pop_input();
+int input_depth();
+
+// next token before preprocessing
+struct Token lex_token();
+// same but gives EOD instead of moving on to the next line
+struct Token lex_directive_token();
+// skip an inactive #if region, up to the next line starting with #
+// the rest of the current line is skipped too, nothing is tokenized
+void skip_inactive();
+
+struct Token lex_at(unsigned int loc, int *len);
+
 struct Token read_token();
+struct Token peek_token(int n);
+
+int save_tokens();
+void restore_tokens(int pos);
+
+// the preprocessed tokens, ending with END
+extern struct Token *tokens;
+extern int n_tokens;
 
 void eat_token(enum TokenKind kind);
 
+enum TokenKind lookup_keyword(const char *str, int len);
+
+const char *lex_number(const char *p, const char *end, struct Token *token);
+
 #endif
@@ -1,35 +1,91 @@
 #include "fail.h"
+#include "flat.h"
+#include "intern.h"
 #include "lexer.h"
 #include "parser.h"
+#include "pch.h"
+#include "preprocessor.h"
 #include "symbols.h"
 #include "ast.h"
+#include "source.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
-  if (argc > 1) {
-    file = argv[1];
-    stream = fopen(argv[1], "r");
+  char *path = NULL;
+  char *emit_pch = NULL;
+  char *use_pch = NULL;
+  int dump_flat = 0;
+  int dump_tokens = 0;
 
-    if (stream == NULL) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--emit-pch") && i + 1 < argc) {
+      emit_pch = argv[++i];
+    } else if (!strcmp(argv[i], "--use-pch") && i + 1 < argc) {
+      use_pch = argv[++i];
+    } else if (!strcmp(argv[i], "--dump-flat")) {
+      dump_flat = 1;
+    } else if (!strcmp(argv[i], "--dump-tokens")) {
+      dump_tokens = 1;
+    } else if (!strcmp(argv[i], "--lex-chunks") && i + 1 < argc) {
+      lex_chunks = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--lazy-bodies")) {
+      lazy_bodies = 1;
+    } else if (!strncmp(argv[i], "-I", 2)) {
+      add_include_path(argv[i][2] ? argv[i] + 2 : argv[++i]);
+    } else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc)) {
+      parse_jobs = atoi(argv[i][2] ? argv[i] + 2 : argv[++i]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  if (path) {
+    source = map_source(path);
+
+    if (source == NULL) {
       printf("Couldn't open file\n");
       exit(2);
     }
   } else {
-    file = "STDIN";
-    stream = stdin;
+    source = read_source(stdin, "STDIN");
+  }
+
+  if (use_pch) {
+    load_pch(use_pch);
+  }
+
+  // only preprocess
+  if (dump_tokens) {
+    setup_lexer();
+    debug_tokens();
+    return 0;
   }
 
   parse();
 
+  if (emit_pch) {
+    write_pch(emit_pch, source);
+    return 0;
+  }
+
   debug_symbols();
 
   printf("\nToken x is: \n  ");
-  debug_symbol(lookup_symbol("x"));
+  debug_symbol(lookup_symbol(intern("x", 1)));
   printf("Token y is: \n  ");
-  debug_symbol(lookup_symbol("y"));
+  debug_symbol(lookup_symbol(intern("y", 1)));
   printf("Main function is:\n");
-  debug_symbol(lookup_symbol("main"));
-  debug_block_stmt(lookup_symbol("main")->func->stmt);
+  debug_symbol(lookup_symbol(intern("main", 4)));
+  debug_block_stmt(func_body(lookup_symbol(intern("main", 4))->func));
+
+  if (dump_flat) {
+    struct FlatAst *flat = flatten_func(lookup_symbol(intern("main", 4))->func);
+
+    printf("\nFlat main is:\n");
+    debug_flat(flat);
+    free_flat(flat);
+  }
 }
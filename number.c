@@ -0,0 +1,329 @@
+// correctly rounded decimal to double conversion
+//
+// literals that fit in 53 bits with a small exponent are exact in double
+// arithmetic (Clinger's fast path), everything else uses the Eisel-Lemire
+// algorithm: multiply by a 128-bit approximation of the power of five and
+// check that the truncated bits can't change the rounding
+// the few cases Eisel-Lemire can't decide fall back to strtod
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+// powers of ten that are exact in a double
+double exact_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// smallest and largest decimal exponent that don't round straight to 0/inf
+#define MIN_POW10 (-342)
+#define MAX_POW10 308
+
+// 128-bit approximations of 5^q normalised so the top bit is set
+// truncated for q >= 0, which is exact up to 5^55
+// rounded up for -27 <= q < 0, where 5^-q fits in 64 bits
+// truncated for q < -27
+// a truncated entry is less than one unit below 5^q, so a product with it is
+// low by less than w in its bottom 64 bits and can only be wrong by a carry
+// out of them, the fallback in eisel_lemire relies on this bound
+// built the first time a literal misses the fast path, which can be on any
+// of the lexer threads
+struct Pow5 {
+  unsigned long long hi;
+  unsigned long long lo;
+} *pow5_table = NULL;
+
+pthread_once_t pow5_once = PTHREAD_ONCE_INIT;
+
+// minimal arbitrary precision unsigned integers for building the table
+// 5^342 is under 800 bits
+#define BIG_LIMBS 32
+
+struct Big {
+  unsigned int limb[BIG_LIMBS]; // least significant first
+  int n;
+};
+
+void big_mul_small(struct Big *b, unsigned int m) {
+  unsigned long long carry = 0;
+
+  for (int i = 0; i < b->n; i++) {
+    carry += (unsigned long long)b->limb[i] * m;
+    b->limb[i] = carry;
+    carry >>= 32;
+  }
+
+  if (carry) {
+    b->limb[b->n++] = carry;
+  }
+}
+
+int big_bits(struct Big *b) {
+  return (b->n - 1) * 32 + (32 - __builtin_clz(b->limb[b->n - 1]));
+}
+
+int big_bit(struct Big *b, int i) {
+  if (i < 0 || i / 32 >= b->n) {
+    return 0;
+  }
+
+  return b->limb[i / 32] >> (i % 32) & 1;
+}
+
+int big_cmp(struct Big *a, struct Big *b) {
+  if (a->n != b->n) {
+    return a->n < b->n ? -1 : 1;
+  }
+
+  for (int i = a->n - 1; i >= 0; i--) {
+    if (a->limb[i] != b->limb[i]) {
+      return a->limb[i] < b->limb[i] ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
+
+// a -= b, a must be >= b
+void big_sub(struct Big *a, struct Big *b) {
+  long long borrow = 0;
+
+  for (int i = 0; i < a->n; i++) {
+    long long d = (long long)a->limb[i] - (i < b->n ? b->limb[i] : 0) - borrow;
+    borrow = d < 0;
+    a->limb[i] = d + (borrow << 32);
+  }
+
+  while (a->n > 1 && a->limb[a->n - 1] == 0) {
+    a->n--;
+  }
+}
+
+void big_shl1(struct Big *b) {
+  unsigned int carry = 0;
+
+  for (int i = 0; i < b->n; i++) {
+    unsigned int top = b->limb[i] >> 31;
+    b->limb[i] = b->limb[i] << 1 | carry;
+    carry = top;
+  }
+
+  if (carry) {
+    b->limb[b->n++] = carry;
+  }
+}
+
+// 128 bits of b starting from bit top and going down
+struct Pow5 big_bits128(struct Big *b, int top) {
+  struct Pow5 r = {0, 0};
+
+  for (int i = 0; i < 64; i++) {
+    r.hi = r.hi << 1 | big_bit(b, top - i);
+    r.lo = r.lo << 1 | big_bit(b, top - 64 - i);
+  }
+
+  return r;
+}
+
+void build_pow5_table() {
+  pow5_table = malloc((MAX_POW10 - MIN_POW10 + 1) * sizeof(*pow5_table));
+
+  struct Big p = {{1}, 1};
+
+  // q >= 0: top 128 bits of 5^q
+  for (int q = 0; q <= MAX_POW10; q++) {
+    pow5_table[q - MIN_POW10] = big_bits128(&p, big_bits(&p) - 1);
+    big_mul_small(&p, 5);
+  }
+
+  // q < 0: 2^(l + 127) / 5^-q where 5^-q has l bits
+  // which lands the quotient in [2^127, 2^128)
+  p = (struct Big){{5}, 1};
+
+  for (int q = -1; q >= MIN_POW10; q--) {
+    int l = big_bits(&p);
+
+    // the dividend down to bit 128 is 2^(l - 1) which is less than p
+    // so only the low 128 quotient bits need long division
+    struct Big rem = {{0}, l / 32 + 1};
+    rem.limb[(l - 1) / 32] = 1u << ((l - 1) % 32);
+
+    while (rem.n > 1 && rem.limb[rem.n - 1] == 0) {
+      rem.n--;
+    }
+
+    struct Pow5 quot = {0, 0};
+
+    for (int i = 127; i >= 0; i--) {
+      big_shl1(&rem);
+
+      if (big_cmp(&rem, &p) >= 0) {
+        big_sub(&rem, &p);
+
+        if (i >= 64) {
+          quot.hi |= 1ull << (i - 64);
+        } else {
+          quot.lo |= 1ull << i;
+        }
+      }
+    }
+
+    // round up where 5^-q fits in 64 bits, below that the quotient is left
+    // truncated, see pow5_table
+    if (q >= -27 && ++quot.lo == 0) {
+      quot.hi++;
+    }
+
+    pow5_table[q - MIN_POW10] = quot;
+    big_mul_small(&p, 5);
+  }
+}
+
+// full 64 x 64 -> 128 bit product
+struct Pow5 mul64(unsigned long long a, unsigned long long b) {
+  unsigned long long a_lo = a & 0xffffffff, a_hi = a >> 32;
+  unsigned long long b_lo = b & 0xffffffff, b_hi = b >> 32;
+
+  unsigned long long ll = a_lo * b_lo;
+  unsigned long long lh = a_lo * b_hi;
+  unsigned long long hl = a_hi * b_lo;
+  unsigned long long hh = a_hi * b_hi;
+
+  unsigned long long mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+
+  struct Pow5 r;
+  r.lo = (mid << 32) | (ll & 0xffffffff);
+  r.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  return r;
+}
+
+double bits_to_double(unsigned long long bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+#define MANTISSA_BITS 52
+#define INF_BITS 0x7ff0000000000000ull
+
+// Eisel-Lemire
+// returns 1 and sets *result if w * 10^q could be rounded correctly
+int eisel_lemire(unsigned long long w, int q, double *result) {
+  if (w == 0 || q < MIN_POW10) {
+    *result = 0.0;
+    return 1;
+  }
+
+  if (q > MAX_POW10) {
+    *result = bits_to_double(INF_BITS);
+    return 1;
+  }
+
+  pthread_once(&pow5_once, build_pow5_table);
+
+  struct Pow5 pow = pow5_table[q - MIN_POW10];
+
+  int lz = __builtin_clzll(w);
+  w <<= lz;
+
+  // we need 55 bits of product, only use the low half of the power when
+  // the high half leaves those uncertain
+  struct Pow5 prod = mul64(w, pow.hi);
+
+  if ((prod.hi & 0x1ff) == 0x1ff) {
+    struct Pow5 second = mul64(w, pow.lo);
+    prod.lo += second.hi;
+
+    if (second.hi > prod.lo) {
+      prod.hi++;
+    }
+
+    // still uncertain, a carry from the bits not multiplied could change
+    // prod.hi, only possible with the truncated entries that aren't exact
+    if (prod.lo == 0xffffffffffffffffull && (q < -27 || q > 55)) {
+      return 0;
+    }
+  }
+
+  int upper = prod.hi >> 63;
+  unsigned long long mantissa = prod.hi >> (upper + 64 - MANTISSA_BITS - 3);
+
+  // binary exponent of 10^q is about q * log2(10)
+  int power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+
+  if (power2 <= 0) {
+    // subnormal
+    if (-power2 + 1 >= 64) {
+      *result = 0.0;
+      return 1;
+    }
+
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+
+    power2 = mantissa < (1ull << MANTISSA_BITS) ? 0 : 1;
+    *result = bits_to_double((mantissa & ~(1ull << MANTISSA_BITS)) |
+                             (unsigned long long)power2 << MANTISSA_BITS);
+    return 1;
+  }
+
+  // exactly halfway between two doubles, round to even
+  if (prod.lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << (upper + 64 - MANTISSA_BITS - 3)) == prod.hi) {
+    mantissa &= ~1ull;
+  }
+
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+
+  if (mantissa >= (2ull << MANTISSA_BITS)) {
+    mantissa = 1ull << MANTISSA_BITS;
+    power2++;
+  }
+
+  mantissa &= ~(1ull << MANTISSA_BITS);
+
+  if (power2 >= 0x7ff) {
+    *result = bits_to_double(INF_BITS);
+    return 1;
+  }
+
+  *result = bits_to_double(mantissa | (unsigned long long)power2 << MANTISSA_BITS);
+  return 1;
+}
+
+double decimal_to_double(unsigned long long w, int q, int truncated,
+                         const char *text, int len) {
+  // Clinger's fast path, both operands and the result are exact
+  if (!truncated && w <= (1ull << 53) && q >= -22 && q <= 22) {
+    if (q < 0) {
+      return (double)w / exact_pow10[-q];
+    }
+
+    return (double)w * exact_pow10[q];
+  }
+
+  double d;
+
+  if (eisel_lemire(w, q, &d)) {
+    // if digits were dropped the value is between w and w + 1
+    // which only works if both round the same way
+    double d_up;
+
+    if (!truncated || (eisel_lemire(w + 1, q, &d_up) && d == d_up)) {
+      return d;
+    }
+  }
+
+  // strtod needs the literal null terminated
+  char *copy = malloc(len + 1);
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+
+  d = strtod(copy, NULL);
+
+  free(copy);
+  return d;
+}
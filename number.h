@@ -0,0 +1,12 @@
+#ifndef NUMBER_HEADER
+#define NUMBER_HEADER
+
+// w * 10^q rounded to the nearest double
+// truncated means digits were dropped from w so the exact mantissa is
+// somewhere between w and w + 1
+// text is the literal, only used for the rare cases that can't be decided
+// from w and q
+double decimal_to_double(unsigned long long w, int q, int truncated,
+                         const char *text, int len);
+
+#endif
@@ -1,9 +1,15 @@
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "fail.h"
+#include "intern.h"
 #include "lexer.h"
 #include "parser.h"
 #include "symbols.h"
@@ -24,23 +30,36 @@
 
 // declarator type for parsing
 struct Dec {
-  struct Type *type;
-  char *identifier;
+  struct Type *type; // canonical
+  unsigned int identifier; // interned, 0 if there is none
+  // named parameters if this declares a function
+  // only valid until the next outer declaration
+  struct Param *params;
+  int n_params;
 };
 
-struct Param *match_params();
-struct Type match_type();
+void match_params(struct FuncSig *sig);
+struct Type *match_type();
 
 struct Type **match_dec_rec(struct Dec *dec, struct Type **type);
 
-struct Dec match_declarator(struct Type type_) {
-  struct Type *type = malloc(sizeof(*type));
-  *type = type_;
+// declarators are built inside out in here, then made canonical
+// reset before each outer declaration and each function body
+_Thread_local struct Arena declarator_arena;
+
+struct Dec match_declarator(struct Type *type) {
   struct Dec dec = {0};
   dec.type = type;
 
   match_dec_rec(&dec, &dec.type);
 
+  if (dec.type->kind == T_FUNC) {
+    dec.params = dec.type->func_sig->params;
+    dec.n_params = dec.type->func_sig->n_params;
+  }
+
+  dec.type = canon_type(dec.type);
+
   return dec;
 }
 
@@ -56,10 +75,10 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
 
     type = match_dec_rec(dec, type);
 
-    struct Type *ptr_type = malloc(sizeof(*ptr_type));
+    struct Type *ptr_type =
+        arena_alloc(&declarator_arena, sizeof(*ptr_type));
     ptr_type->kind = T_POINTER;
     ptr_type->ptr_type = *type;
-    ptr_type->istypedef = 0;
 
     *type = ptr_type;
 
@@ -69,7 +88,7 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
     eat_token('(');
 
     if (cur_token.kind == ')') {
-      printf("Syntax error: Expected identifier, found ')'\n");
+      error_printf("Syntax error: Expected identifier, found ')'\n");
       FAIL;
     }
 
@@ -79,8 +98,7 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
     break;
 
   case IDENT:
-    dec->identifier = malloc(strlen(cur_token.identifier) + 1);
-    strcpy(dec->identifier, cur_token.identifier);
+    dec->identifier = cur_token.ident;
     eat_token(IDENT);
 
     break;
@@ -89,20 +107,20 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
   case ';':
   case ',':
     // no identifier
-    dec->identifier = NULL;
+    dec->identifier = 0;
 
     return type;
 
   case '[':
     // no identifier
 
-    dec->identifier = NULL;
+    dec->identifier = 0;
 
     break;
 
   default:
-    printf("Syntax error: Expected identifier, found %s\n",
-           token_repr[cur_token.kind]);
+    error_printf("Syntax error: Expected identifier, found %s\n",
+                 token_repr[cur_token.kind]);
     FAIL;
   }
 
@@ -119,12 +137,12 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
 
       eat_token(']');
 
-      struct Type *arr_type = malloc(sizeof(*arr_type));
+      struct Type *arr_type =
+          arena_alloc(&declarator_arena, sizeof(*arr_type));
 
       arr_type->kind = T_ARRAY;
       arr_type->array.elem_type = *type;
       arr_type->array.len = len;
-      arr_type->istypedef = 0;
 
       *type = arr_type;
       type = &arr_type->array.elem_type;
@@ -132,15 +150,14 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
       continue;
     case '(':;
       // turn type into function
-      struct Param *params = match_params();
-
-      struct Type *f_type = malloc(sizeof(*f_type));
+      struct Type *f_type =
+          arena_alloc(&declarator_arena, sizeof(*f_type));
 
       f_type->kind = T_FUNC;
-      f_type->func_sig = malloc(sizeof(*f_type->func_sig));
-      f_type->func_sig->params = params;
+      f_type->func_sig =
+          arena_alloc(&declarator_arena, sizeof(*f_type->func_sig));
+      match_params(f_type->func_sig);
       f_type->func_sig->ret = *type;
-      f_type->istypedef = 0;
 
       *type = f_type;
       type = &f_type->func_sig->ret;
@@ -157,81 +174,90 @@ struct Type **match_dec_rec(struct Dec *dec, struct Type **type) {
 }
 
 // match fields of struct or union
-struct Field *match_fields() {
+// they are collected in a buffer, then frozen into one array
+void match_fields(struct Struct *struc) {
   eat_token('{');
 
   struct Field *fields = NULL;
-  struct Field **tail = &fields;
+  int n_fields = 0;
+  int cap = 0;
 
   while (cur_token.kind != '}') {
-    struct Type type = match_type();
+    struct Type *type = match_type();
     struct Dec dec = match_declarator(type);
 
-    if (dec.identifier == NULL) {
+    if (!dec.identifier) {
       // anonymous struct or union definition means that the struct has those
       // members
       if (dec.type->kind == T_STRUCT || dec.type->kind == T_UNION) {
-        if (dec.type->struct_type->name == NULL) {
-          // add as a field with NULL identifier
+        if (!dec.type->struct_type->name) {
+          // add as a field with no identifier
         } else {
-          printf("Semantic error: Struct field with no identifier\n");
+          error_printf("Semantic error: Struct field with no identifier\n");
           FAIL;
         }
       } else {
-        printf("Semantic error: Struct field with no identifier\n");
+        error_printf("Semantic error: Struct field with no identifier\n");
         FAIL;
       }
     }
 
-    *tail = malloc(sizeof(**tail));
-
-    (*tail)->type = dec.type;
-    (*tail)->name = dec.identifier;
-    (*tail)->next = NULL;
+    if (n_fields == cap) {
+      cap = cap ? 2 * cap : 8;
+      fields = realloc(fields, cap * sizeof(*fields));
+    }
 
-    tail = &(*tail)->next;
+    fields[n_fields++] = (struct Field){dec.identifier, dec.type, 0};
 
     eat_token(';');
   }
 
   eat_token('}');
 
-  return fields;
+  struc->fields = lasting_copy(fields, n_fields * sizeof(*fields));
+  struc->n_fields = n_fields;
+
+  free(fields);
 }
 
-// match parameters of function
-struct Param *match_params() {
+// match parameters of function into sig
+// they are collected in a buffer, then frozen into one array
+void match_params(struct FuncSig *sig) {
   eat_token('(');
 
   struct Param *params = NULL;
-  struct Param **tail = &params;
+  int n_params = 0;
+  int cap = 0;
 
   while (cur_token.kind != ')') {
-    struct Type type = match_type();
+    struct Type *type = match_type();
     struct Dec dec = match_declarator(type);
 
-    *tail = malloc(sizeof(**tail));
-
-    (*tail)->type = dec.type;
-    (*tail)->name = dec.identifier;
-    (*tail)->next = NULL;
+    if (n_params == cap) {
+      cap = cap ? 2 * cap : 8;
+      params = realloc(params, cap * sizeof(*params));
+    }
 
-    tail = &(*tail)->next;
+    params[n_params++] = (struct Param){dec.identifier, dec.type};
 
     if (cur_token.kind == ',') {
       eat_token(',');
     } else if (cur_token.kind != ')') {
-      printf("Syntax error: Expected ',' or ')' in parameter list\n");
+      error_printf("Syntax error: Expected ',' or ')' in parameter list\n");
       FAIL;
     }
   }
 
   eat_token(')');
 
-  return params;
+  sig->params = arena_copy(&declarator_arena, params,
+                           n_params * sizeof(*params));
+  sig->n_params = n_params;
+
+  free(params);
 }
 
-struct Type match_struct() {
+struct Type *match_struct() {
   // add new definition to scope
   // struct-definition ::= `struct` name | `struct` name {} | `struct` {}
   eat_token(STRUCT);
@@ -240,8 +266,7 @@ struct Type match_struct() {
   type.kind = T_STRUCT;
 
   if (cur_token.kind == IDENT) {
-    char name[256];
-    strcpy(name, cur_token.identifier);
+    unsigned int name = cur_token.ident;
 
     eat_token(IDENT);
 
@@ -249,10 +274,12 @@ struct Type match_struct() {
       type.struct_type = add_struct(name);
 
       if (type.struct_type->complete) {
-        printf("Semantic error: redefining struct\n");
+        error_printf("Semantic error: redefining struct\n");
+        FAIL;
       }
 
-      type.struct_type->fields = match_fields();
+      match_fields(type.struct_type);
+      type.struct_type->complete = 1;
     } else {
       type.struct_type = lookup_struct(name);
 
@@ -262,23 +289,23 @@ struct Type match_struct() {
     }
   } else if (cur_token.kind == '{') {
     // anonymous struct
-    struct Field *fields = match_fields();
-    struct Struct *struc = malloc(sizeof(*struc));
+    struct Struct *struc = lasting_alloc(sizeof(*struc));
 
-    struc->name = NULL;
-    struc->fields = fields;
+    struc->name = 0;
+    match_fields(struc);
+    struc->complete = 1;
     type.struct_type = struc;
   } else {
-    printf("Syntax error: Expected identifier or definition after 'struct', "
-           "found %s\n",
-           token_repr[cur_token.kind]);
+    error_printf("Syntax error: Expected identifier or definition after "
+                 "'struct', found %s\n",
+                 token_repr[cur_token.kind]);
     FAIL;
   }
 
-  return type;
+  return canon_type(&type);
 }
 
-struct Type match_type() {
+struct Type *match_type() {
   // type ::=
   //   | struct/union definition
   //     - FIRST = `struct` or `union`
@@ -299,35 +326,60 @@ struct Type match_type() {
     FAIL;
   } else if (cur_token.kind == INT_TYPE) {
     eat_token(INT_TYPE);
-    return (struct Type){.kind = T_INT};
+    return canon_type(&(struct Type){.kind = T_INT});
   } else if (cur_token.kind == CHAR_TYPE) {
     eat_token(CHAR_TYPE);
-    return (struct Type){.kind = T_CHAR};
+    return canon_type(&(struct Type){.kind = T_CHAR});
   } else if (cur_token.kind == VOID_TYPE) {
     eat_token(VOID_TYPE);
-    return (struct Type){.kind = T_VOID};
+    return canon_type(&(struct Type){.kind = T_VOID});
   } else if (cur_token.kind == FLOAT_TYPE) {
     eat_token(FLOAT_TYPE);
-    return (struct Type){.kind = T_FLOAT};
+    return canon_type(&(struct Type){.kind = T_FLOAT});
   } else if (cur_token.kind == IDENT) {
-    struct Symbol *sym = lookup_symbol(cur_token.identifier);
+    struct Symbol *sym = lookup_symbol(cur_token.ident);
 
     if (sym && sym->kind == S_TYPEDEF) {
       eat_token(IDENT);
-      return *sym->type;
+      return sym->type;
     }
 
-    printf("Expected type, found %s\n", cur_token.identifier);
+    error_printf("Expected type, found %s\n", intern_str(cur_token.ident));
     FAIL;
   }
 
-  printf("Couldn't match type %s", token_repr[cur_token.kind]);
+  error_printf("Couldn't match type %s", token_repr[cur_token.kind]);
   FAIL;
-  return (struct Type){0};
+  return NULL;
 }
 
 struct BlockStmt *match_block_stmt();
 
+// parse the body of def, params are its named parameters
+void match_body(struct Func *def, struct Param *params, int n_params) {
+  cur_func = NULL;
+  new_scope();
+
+  // add parameters to symbol table
+  for (int i = 0; i < n_params; i++) {
+    if (params[i].name)
+      add_local(params[i].name, params[i].type);
+  }
+
+  // match inside function
+  def->stmt = match_block_stmt();
+  freeze_locals(def);
+
+  // clean up
+  exit_scope();
+}
+
+void skip_body(struct Func *def, struct Param *params, int n_params);
+void need_body(struct Func *func);
+
+// set while skimming, see parse_parallel
+int skimming = 0;
+
 // parse outer declaration
 void match_outer_dec() {
   // external declarations ::=
@@ -347,20 +399,22 @@ void match_outer_dec() {
     return;
   }
 
+  arena_reset(&declarator_arena);
+
   if (cur_token.kind == TYPEDEF) {
     eat_token(TYPEDEF);
 
-    struct Type type = match_type();
+    struct Type *type = match_type();
 
     if (cur_token.kind == ';') {
-      printf("Syntax error: No identifier after typedef");
+      error_printf("Syntax error: No identifier after typedef");
       FAIL;
     }
 
     struct Dec dec = match_declarator(type);
 
-    if (dec.identifier == NULL) {
-      printf("Syntax error: No identifier after typedef");
+    if (!dec.identifier) {
+      error_printf("Syntax error: No identifier after typedef");
       FAIL;
     }
 
@@ -373,31 +427,24 @@ void match_outer_dec() {
 
     if (prev) {
       if (prev->kind != S_TYPEDEF) {
-        printf("Semantic error: redefining symbol %s as a type\n",
-               dec.identifier);
+        error_printf("Semantic error: redefining symbol %s as a type\n",
+                     intern_str(dec.identifier));
         FAIL;
-      } else if (!type_eq(dec.type, prev->type)) {
-        printf("Semantic error: redefining type %s as another type\n",
-               dec.identifier);
+      } else if (dec.type != prev->type) {
+        error_printf("Semantic error: redefining type %s as another type\n",
+                     intern_str(dec.identifier));
         FAIL;
       }
-
-      // don't need this
-      free_type(sym.type);
     } else {
-      sym.type->istypedef = 1;
-
       *add_symbol(dec.identifier) = sym;
     }
 
-    free(dec.identifier);
-
     eat_token(';');
 
     return;
   }
 
-  struct Type type = match_type();
+  struct Type *type = match_type();
 
   if (cur_token.kind == ';') {
     eat_token(';');
@@ -406,11 +453,10 @@ void match_outer_dec() {
 
   struct Dec dec = match_declarator(type);
   type_verify(dec.type);
-  int _line = line;
-  int _line_col = line_col;
+  unsigned int _loc = cur_token.loc;
 
-  if (dec.identifier == NULL) {
-    printf("Syntax error: Expected identifier\n");
+  if (!dec.identifier) {
+    error_printf("Syntax error: Expected identifier\n");
     FAIL;
   }
 
@@ -419,9 +465,6 @@ void match_outer_dec() {
 
     func.sig = dec.type->func_sig;
 
-    if (!dec.type->istypedef)
-      free(dec.type);
-
     func.stmt = NULL;
 
     if (cur_token.kind == '{') {
@@ -433,56 +476,40 @@ void match_outer_dec() {
     struct Func *def = add_func(dec.identifier);
 
     if (def->complete && func.complete) {
-      printf("Semantic error: Redefining function %s\n", dec.identifier);
+      error_printf("Semantic error: Redefining function %s\n",
+                   intern_str(dec.identifier));
       FAIL;
     }
 
     if (def->sig) {
-      if (!compare_func_sig(def->sig, func.sig)) {
-        printf(
+      if (def->sig != func.sig) {
+        error_printf(
             "Semantic error: redefining function with different signature\n");
-        line = _line;
-        line_col = _line_col;
+        fail_loc = _loc;
         FAIL;
       }
-
-      // both are equal
-      free_func_sig(func.sig);
     } else {
       def->sig = func.sig;
     }
 
     if (func.complete) {
-      cur_func = NULL;
-      new_scope();
-
-      // add parameters to symbol table
-      struct Param *cur = func.sig->params;
-
-      while (cur != NULL) {
-        add_local(cur->name, cur->type);
-
-        cur = cur->next;
-      }
-
-      // match inside function
-      def->stmt = match_block_stmt();
+      def->complete = 1;
+    }
 
-      // clean up
-      exit_scope();
+    if (func.complete && (skimming || lazy_bodies)) {
+      skip_body(def, dec.params, dec.n_params);
+    } else if (func.complete) {
+      match_body(def, dec.params, dec.n_params);
     }
   } else if (cur_token.kind == ';') {
     struct Global *global = add_global(dec.identifier);
 
     if (global->type) {
-      if (!type_eq(global->type, dec.type)) {
-        printf("Semantic error: redefining global with different type\n");
-        line = _line;
-        line_col = _line_col;
+      if (global->type != dec.type) {
+        error_printf("Semantic error: redefining global with different type\n");
+        fail_loc = _loc;
         FAIL;
       }
-
-      free_type(dec.type);
     } else {
       global->type = dec.type;
     }
@@ -501,29 +528,23 @@ void match_outer_dec() {
     struct Global *global = add_global(dec.identifier);
 
     if (global->type) {
-      if (!type_eq(global->type, dec.type)) {
-        printf("Semantic error: redefining global with different type\n");
-        line = _line;
-        line_col = _line_col;
+      if (global->type != dec.type) {
+        error_printf("Semantic error: redefining global with different type\n");
+        fail_loc = _loc;
         FAIL;
       }
-
-      free_type(dec.type);
     } else {
       global->type = dec.type;
     }
 
     if (global->complete) {
-      printf("Semantic error: redefining global\n");
-      line = _line;
-      line_col = _line_col;
+      error_printf("Semantic error: redefining global\n");
+      fail_loc = _loc;
       FAIL;
     }
 
     // TODO store initializer in global
   }
-
-  free(dec.identifier);
 }
 
 struct Expr *match_expr();
@@ -561,254 +582,534 @@ struct Stmt *match_inner_dec() {
   return NULL;
 }
 
-// prefix operators
-// TODO:  ++ -- & + - ~ !
+// whether the current token starts a type name
+int starts_type() {
+  switch (cur_token.kind) {
+  case INT_TYPE:
+  case CHAR_TYPE:
+  case VOID_TYPE:
+  case FLOAT_TYPE:
+  case STRUCT:
+  case UNION:
+  case ENUM:
+    return 1;
+  case IDENT:;
+    struct Symbol *sym = lookup_symbol(cur_token.ident);
+    return sym && sym->kind == S_TYPEDEF;
+  default:
+    return 0;
+  }
+}
+
+// type-name ::= type abstract-declarator
+struct Type *match_type_name() {
+  struct Dec dec = match_declarator(match_type());
+
+  if (dec.identifier) {
+    error_printf("Syntax error: Unexpected identifier in type name\n");
+    FAIL;
+  }
+
+  return dec.type;
+}
+
+// expressions are parsed without recursion
+//
+// finished expressions are pushed on the operand stack, and operators wait on
+// the pending stack until an operator of lower precedence, a closing bracket
+// or the end of the expression shows that their operands are complete. long
+// chains and deep nesting only grow the stacks
+//
+// expr ::=
+//   | `prefix-op` expr
+//   | ( type-name ) expr
+//   | expr `postfix-op`
+//   | expr `op` expr
+//   | expr ? expr : expr
+//   | var-name | constant | ( expr )
+//   | sizeof expr | sizeof ( type-name )
+//
+// indexing, calling functions and member access are postfix operators
+// postfix operators bind tighter than anything that can be pending, so they
+// are applied to the operand on top as soon as they are read
+
+// precedence of binary operators by token, 0 if the token isn't one
+// operators are left assoc except for assignment which is right assoc
+int precedences[256] = {
+    // arithmetic
+    [STAR] = 13, [SLASH] = 13, [MOD] = 13,
+    [PLUS] = 12, [MINUS] = 12,
+    [SHL] = 11, [SHR] = 11,
+
+    // comparisons
+    [LT] = 10, [GT] = 10, [LTE] = 10, [GTE] = 10,
+    [EQ] = 9, [NE] = 9,
+
+    // bitwise and logic
+    [AMP] = 8, [CARET] = 7, [PIPE] = 6,
+    [AND] = 5, [OR] = 4,
+
+    // 3 is ? :
+
+    // assignment
+    [ASSIGN] = 2, [MUL_ASSIGN] = 2, [DIV_ASSIGN] = 2,
+    [MOD_ASSIGN] = 2, [ADD_ASSIGN] = 2, [SUB_ASSIGN] = 2,
+    [SHL_ASSIGN] = 2, [SHR_ASSIGN] = 2, [AND_ASSIGN] = 2,
+    [XOR_ASSIGN] = 2, [OR_ASSIGN] = 2,
+
+    [COMMA] = 1,
+};
+
+#define COND_PRECEDENCE 3
+#define ASSIGN_PRECEDENCE 2
+#define PREFIX_PRECEDENCE 14
+
+enum BinOp operators[256] = {
+    // arithmetic
+    [STAR] = O_MUL,
+    [SLASH] = O_DIV,
+    [MOD] = O_MOD,
+    [PLUS] = O_ADD,
+    [MINUS] = O_SUB,
+    [SHL] = O_SHL,
+    [SHR] = O_SHR,
+
+    // comparisons
+    [LT] = O_LT,
+    [GT] = O_GT,
+    [LTE] = O_LTE,
+    [GTE] = O_GTE,
+    [EQ] = O_EQ,
+    [NE] = O_NE,
+
+    // bitwise and logic
+    [AMP] = O_BIT_AND,
+    [CARET] = O_BIT_XOR,
+    [PIPE] = O_BIT_OR,
+    [AND] = O_AND,
+    [OR] = O_OR,
+
+    // assignment
+    [ASSIGN] = O_ASSIGN,
+    [MUL_ASSIGN] = O_MUL_ASSIGN,
+    [DIV_ASSIGN] = O_DIV_ASSIGN,
+    [MOD_ASSIGN] = O_MOD_ASSIGN,
+    [ADD_ASSIGN] = O_ADD_ASSIGN,
+    [SUB_ASSIGN] = O_SUB_ASSIGN,
+    [SHL_ASSIGN] = O_SHL_ASSIGN,
+    [SHR_ASSIGN] = O_SHR_ASSIGN,
+    [AND_ASSIGN] = O_AND_ASSIGN,
+    [XOR_ASSIGN] = O_XOR_ASSIGN,
+    [OR_ASSIGN] = O_OR_ASSIGN,
+
+    [COMMA] = O_COMMA,
+};
+
+// prefix operators, 0 if the token isn't one
 enum UnOp unoperators[256] = {
-    [AMP] = O_REF,
-    [STAR] = O_DEREF,
+    [STAR] = O_DEREF, [AMP] = O_REF,   [NOT] = O_NOT,
+    [MINUS] = O_NEG,  [PLUS] = O_PLUS, [TILDE] = O_BIT_NOT,
+    [INC] = O_PRE_INC, [DEC] = O_PRE_DEC,
 };
 
-struct Args *match_args() {
-  eat_token('(');
+// something on the pending stack
+struct Pending {
+  enum {
+    // operators, waiting for their last operand
+    P_BINOP,
+    P_UNOP,
+    P_SIZEOF,
+    P_CAST,
+    P_ELSE, // : of a conditional
+
+    // brackets, waiting to be closed
+    P_PAREN,
+    P_INDEX,
+    P_CALL, // operands above the function are its arguments
+    P_COND, // ? of a conditional, closed by :
+  } kind;
+
+  int precedence; // of operators
+  int op;
+  struct Type *type; // of casts
+  int base;          // operand stack height at a call
+};
 
-  struct Args *args = NULL;
-  struct Args **tail = &args;
+_Thread_local struct Expr **operands = NULL;
+_Thread_local int n_operands = 0;
+_Thread_local int operands_cap = 0;
 
-  while (cur_token.kind != ')') {
-    struct Expr *expr = match_expr();
+_Thread_local struct Pending *pending = NULL;
+_Thread_local int n_pending = 0;
+_Thread_local int pending_cap = 0;
 
-    *tail = malloc(sizeof(**tail));
+void push_operand(struct Expr *expr) {
+  if (n_operands == operands_cap) {
+    operands_cap = operands_cap ? 2 * operands_cap : 64;
+    operands = realloc(operands, operands_cap * sizeof(*operands));
+  }
 
-    (*tail)->expr = expr;
-    (*tail)->next = NULL;
+  operands[n_operands++] = expr;
+}
 
-    tail = &(*tail)->next;
+void push_pending(struct Pending p) {
+  if (n_pending == pending_cap) {
+    pending_cap = pending_cap ? 2 * pending_cap : 64;
+    pending = realloc(pending, pending_cap * sizeof(*pending));
+  }
 
-    if (cur_token.kind == ',') {
-      eat_token(',');
-    } else if (cur_token.kind != ')') {
-      printf("Syntax error: Expected ',' or ')' in argument list\n");
-      FAIL;
+  pending[n_pending++] = p;
+}
+
+struct Expr *new_expr(struct Expr expr) {
+  struct Expr *new = lasting_alloc(sizeof(*new));
+  *new = expr;
+  return new;
+}
+
+// apply pending operators of at least the precedence to their operands
+// stops at brackets and at base, the bottom of the current expression
+void reduce(int base, int precedence) {
+  while (n_pending > base) {
+    struct Pending *p = &pending[n_pending - 1];
+
+    if (p->kind >= P_PAREN || p->precedence < precedence) {
+      return;
     }
+
+    struct Expr **top = &operands[n_operands - 1];
+
+    switch (p->kind) {
+    case P_BINOP:
+      top[-1] = new_expr((struct Expr){.kind = E_BINOP,
+                                       .binop = {p->op, top[-1], top[0]}});
+      n_operands--;
+      break;
+    case P_UNOP:
+      *top = new_expr((struct Expr){.kind = E_UNOP, .unop = {p->op, *top}});
+      break;
+    case P_SIZEOF:
+      *top = new_expr((struct Expr){
+          .kind = E_CONST,
+          .cnst = {.kind = C_INT, .int_literal = type_size(expr_type(*top))}});
+      break;
+    case P_CAST:
+      *top = new_expr((struct Expr){.kind = E_CAST, .cast = {p->type, *top}});
+      break;
+    case P_ELSE:
+      top[-2] = new_expr((struct Expr){.kind = E_COND,
+                                       .cond = {top[-2], top[-1], top[0]}});
+      n_operands -= 2;
+      break;
+    default:
+      break;
+    }
+
+    n_pending--;
   }
+}
 
-  eat_token(')');
+// the bracket that the current position is inside, NULL if there is none
+struct Pending *open_bracket(int base) {
+  if (n_pending > base && pending[n_pending - 1].kind >= P_PAREN) {
+    return &pending[n_pending - 1];
+  }
 
-  return args;
+  return NULL;
 }
 
-// similar to match_dec_rec
-// primary ::=
-//   | var-name
-//   | constant
-//   | ( expr )
-//   | `prefix-op` primary
-//   | primary `postfix-op`
-//
-// indexing and calling functions are postfix operators
-// '*' and '&' are prefix operators
-// postfix operators have higher precedence than prefix operators
-//
-// parsed like declarators
-struct Expr *match_primary_expr() {
-  struct Expr *expr = malloc(sizeof(*expr));
-
-  // prefix operators
-  while (unoperators[cur_token.kind]) {
-    expr->kind = E_UNOP;
-    expr->unop.op = unoperators[cur_token.kind];
-    expr->unop.expr = malloc(sizeof(*expr->unop.expr));
-    expr = expr->unop.expr;
-    read_token();
+void member_access(int arrow) {
+  struct Expr **top = &operands[n_operands - 1];
+
+  if (cur_token.kind != IDENT) {
+    error_printf("Syntax error: Expected member name, found %s\n",
+                 token_repr[cur_token.kind]);
+    FAIL;
+  }
+
+  struct Type *type = expr_type(*top);
+
+  if (arrow) {
+    type = type->kind == T_POINTER ? type->ptr_type : NULL;
   }
 
-  // primary
+  if (type == NULL || (type->kind != T_STRUCT && type->kind != T_UNION)) {
+    error_printf("Semantic error: member access on non-struct type '");
+    debug_type(expr_type(*top));
+    error_printf("'\n");
+    FAIL;
+  }
+
+  struct Member *member = struct_member(type, cur_token.ident);
+
+  if (!member) {
+    error_printf("Semantic error: no member named %s in '",
+                 intern_str(cur_token.ident));
+    debug_type(type);
+    error_printf("'\n");
+    FAIL;
+  }
+
+  eat_token(IDENT);
+
+  *top = new_expr(
+      (struct Expr){.kind = E_MEMBER, .member = {*top, member, arrow}});
+}
+
+// match a primary expression and push it
+void match_primary() {
   switch (cur_token.kind) {
   case INTEGER:
-    *expr = (struct Expr){
+    push_operand(new_expr((struct Expr){
         .kind = E_CONST,
-        .cnst = {.kind = C_INT, .int_literal = cur_token.int_literal}};
+        .cnst = {.kind = C_INT, .int_literal = cur_token.int_literal}}));
 
     read_token();
     break;
   case IDENT:;
-    struct Symbol *sym = lookup_symbol(cur_token.identifier);
+    struct Symbol *sym = lookup_symbol(cur_token.ident);
 
     if (!sym) {
-      printf("Undefined symbol \"%s\" in expression\n", cur_token.identifier);
+      error_printf("Undefined symbol \"%s\" in expression\n",
+                   intern_str(cur_token.ident));
       FAIL;
     }
 
     if (sym->kind == S_VAR) {
-      *expr = (struct Expr){.kind = E_VAR, .var = sym->var};
+      push_operand(new_expr((struct Expr){.kind = E_VAR, .var = sym->var}));
     } else if (sym->kind == S_GLOBAL) {
-      *expr = (struct Expr){.kind = E_GLOBAL, .global = sym->global};
+      push_operand(
+          new_expr((struct Expr){.kind = E_GLOBAL, .global = sym->global}));
     } else if (sym->kind == S_FUNC) {
-      *expr = (struct Expr){.kind = E_FUNC, .func = sym->func};
+      need_body(sym->func);
+      push_operand(new_expr((struct Expr){.kind = E_FUNC, .func = sym->func}));
     } else {
-      printf("Unexpected symbol %s \"%s\" in expression\n",
-             symbol_repr[sym->kind], cur_token.identifier);
+      error_printf("Unexpected symbol %s \"%s\" in expression\n",
+                   symbol_repr[sym->kind], intern_str(cur_token.ident));
       FAIL;
     }
     read_token();
     break;
-  case '(':
-    eat_token('(');
-    expr = match_expr();
-    eat_token(')');
-    break;
   default:
-    printf("Syntax error: Unexpected %s in expression\n",
-           token_repr[cur_token.kind]);
+    error_printf("Syntax error: Unexpected %s in expression\n",
+                 token_repr[cur_token.kind]);
     FAIL;
   }
+}
+
+// comma is whether a comma outside of brackets is an operator, otherwise it
+// ends the expression like in initializers
+struct Expr *match_expr_with(int comma) {
+  // this expression only uses the stacks above these
+  int operand_base = n_operands;
+  int pending_base = n_pending;
 
-  // postfix operators
-  // TODO: ++ -- -> .
+  struct Pending *bracket;
+
+operand:
+  // prefix operators and opening brackets until the primary
   while (1) {
-    if (cur_token.kind == '[') {
-      eat_token('[');
-      struct Expr *new = malloc(sizeof(*new));
-      *new = (struct Expr){.kind = E_BINOP,
-                           .binop = {O_INDEX, expr, match_expr()}};
-      expr = new;
-      eat_token(']');
+    if (unoperators[cur_token.kind]) {
+      push_pending((struct Pending){.kind = P_UNOP,
+                                    .precedence = PREFIX_PRECEDENCE,
+                                    .op = unoperators[cur_token.kind]});
+      read_token();
+    } else if (cur_token.kind == SIZEOF) {
+      eat_token(SIZEOF);
+
+      if (cur_token.kind != '(') {
+        push_pending((struct Pending){.kind = P_SIZEOF,
+                                      .precedence = PREFIX_PRECEDENCE});
+        continue;
+      }
+
+      eat_token('(');
+
+      if (starts_type()) {
+        struct Type *type = match_type_name();
+        eat_token(')');
+
+        push_operand(new_expr((struct Expr){
+            .kind = E_CONST,
+            .cnst = {.kind = C_INT, .int_literal = type_size(type)}}));
+        break;
+      }
+
+      // the bracket is part of the operand
+      push_pending((struct Pending){.kind = P_SIZEOF,
+                                    .precedence = PREFIX_PRECEDENCE});
+      push_pending((struct Pending){.kind = P_PAREN});
     } else if (cur_token.kind == '(') {
-      struct Expr *new = malloc(sizeof(*new));
-      *new = (struct Expr){.kind = E_CALL, .call = {expr, match_args()}};
-      expr = new;
+      eat_token('(');
+
+      if (starts_type()) {
+        struct Type *type = match_type_name();
+        eat_token(')');
+
+        push_pending((struct Pending){
+            .kind = P_CAST, .precedence = PREFIX_PRECEDENCE, .type = type});
+      } else {
+        push_pending((struct Pending){.kind = P_PAREN});
+      }
     } else {
+      match_primary();
       break;
     }
   }
 
-  return expr;
-}
-
-// precedence of tokens for different operators
-// operators are left assoc except for assignment which is right assoc
-// 1 * / %
-// 2 + -
-// 3 >> <<
-// 4 > < >= <=
-// 5 == !=
-// 6 & then ^ then | then && then ||
-// 7 ternary ? :
-// 8 assignment = += -=
-// TODO: unfinished
-// precedence[op] is 0 for operators that aren't written below
-int precedences[256] = {
-    [STAR] = 6, [SLASH] = 6, [MOD] = 6,            // multiplicative ops
-    [PLUS] = 5, [MINUS] = 5,                       // additive ops
-    [LT] = 4,   [GT] = 4,    [LTE] = 4, [GTE] = 4, // comparisons
-    [EQ] = 3,   [NE] = 3,                          // == !=
-    [AND] = 2,  [OR] = 1,                          // logic
-};
+  // postfix operators, then a binary operator or a closing bracket
+  while (1) {
+    int kind = cur_token.kind;
 
-enum BinOp operators[256] = {
-    // arithmetic
-    [STAR] = O_MUL,
-    [SLASH] = O_DIV,
-    [MOD] = O_MOD,
-    [PLUS] = O_ADD,
-    [MINUS] = O_SUB,
+    switch (kind) {
+    case '[':
+      eat_token('[');
+      push_pending((struct Pending){.kind = P_INDEX});
+      goto operand;
+    case '(':
+      eat_token('(');
+      push_pending((struct Pending){.kind = P_CALL, .base = n_operands});
+
+      if (cur_token.kind != ')') {
+        goto operand;
+      }
 
-    // comparisons
-    [LT] = O_LT,
-    [GT] = O_GT,
-    [LTE] = O_LTE,
-    [GTE] = O_GTE,
-    [EQ] = O_EQ,
-    [NE] = O_NE,
+      // no arguments, close it straight away
+      continue;
+    case '.':
+    case ARROW:
+      read_token();
+      member_access(kind == ARROW);
+      continue;
+    case INC:
+    case DEC:
+      operands[n_operands - 1] = new_expr(
+          (struct Expr){.kind = E_UNOP,
+                        .unop = {kind == INC ? O_POST_INC : O_POST_DEC,
+                                 operands[n_operands - 1]}});
+      read_token();
+      continue;
+    case ']':
+    case ')':
+      reduce(pending_base, 0);
+      bracket = open_bracket(pending_base);
+
+      if (bracket == NULL) {
+        // closes a bracket outside of this expression
+        goto end;
+      }
 
-    // logic
-    [AND] = O_AND,
-    [OR] = O_OR,
-};
+      if (kind == ']' && bracket->kind == P_INDEX) {
+        struct Expr **top = &operands[n_operands - 1];
+
+        top[-1] = new_expr((struct Expr){.kind = E_BINOP,
+                                         .binop = {O_INDEX, top[-1], top[0]}});
+        n_operands--;
+      } else if (kind == ')' && bracket->kind == P_PAREN) {
+        // the operand is already on top
+      } else if (kind == ')' && bracket->kind == P_CALL) {
+        struct Expr *call = new_expr((struct Expr){
+            .kind = E_CALL, .call = {operands[bracket->base - 1], NULL, 0}});
+        int n_args = n_operands - bracket->base;
+
+        call->call.args = lasting_copy(&operands[bracket->base],
+                                       n_args * sizeof(*call->call.args));
+        call->call.n_args = n_args;
+
+        n_operands = bracket->base;
+        operands[n_operands - 1] = call;
+      } else {
+        error_printf("Syntax error: Unexpected %s in expression\n",
+                     token_repr[kind]);
+        FAIL;
+      }
 
-// construct expression from the left hand side and the precedence
-// precedence is the minumum precedence for the lhs to be applied with the next
-// operator instead of the previous one
-struct Expr *match_expr_op(struct Expr *lhs, int precedence) {
-  // from wikipedia:
-  //
-  // parse_expression_1(lhs, min_precedence)
-  //   lookahead := peek next token
-  //
-  //   while (lookahead is a binary operator whose precedence is >=
-  //          min_precedence)
-  //     op := lookahead
-  //     advance to next token
-  //     rhs := parse_primary ()
-  //     lookahead := peek next token
-  //
-  //     while (lookahead is a binary operator whose precedence is greater
-  //            than op's, or a right-associative operator
-  //            whose precedence is equal to op's)
-  //       rhs := parse_expression_1 (rhs, precedence of op + (1 if lookahead
-  //              precedence is greater, else 0))
-  //       lookahead := peek next token
-  //
-  //     lhs := the result of applying op with operands lhs and rhs
-  //   return lhs
+      n_pending--;
+      read_token();
+      continue;
+    case '?':
+      reduce(pending_base, COND_PRECEDENCE + 1);
+      eat_token('?');
+      push_pending((struct Pending){.kind = P_COND});
+      goto operand;
+    case ':':
+      reduce(pending_base, 0);
+      bracket = open_bracket(pending_base);
+
+      if (bracket == NULL) {
+        goto end;
+      }
 
-  int cur_precedence = precedences[cur_token.kind];
+      if (bracket->kind != P_COND) {
+        error_printf("Syntax error: Unexpected ':' in expression\n");
+        FAIL;
+      }
 
-  // if this operator has higher precedence than the one before lhs
-  while (cur_precedence > precedence) {
-    enum BinOp op = operators[cur_token.kind];
-    read_token();
+      // the then operand is done, wait for the else operand
+      *bracket =
+          (struct Pending){.kind = P_ELSE, .precedence = COND_PRECEDENCE};
+      eat_token(':');
+      goto operand;
+    case ',':
+      reduce(pending_base, 1);
+      bracket = open_bracket(pending_base);
+
+      if (bracket && bracket->kind == P_CALL) {
+        // separates arguments, which are left on the operand stack
+        eat_token(',');
+        goto operand;
+      }
 
-    struct Expr *rhs = match_primary_expr();
-    int next_precedence = precedences[cur_token.kind];
+      if (bracket == NULL && !comma) {
+        goto end;
+      }
 
-    // if the next operator has higher precedence than cur we apply rhs
-    while (next_precedence > cur_precedence) {
-      rhs = match_expr_op(rhs, cur_precedence);
-      next_precedence = precedences[cur_token.kind];
+      break;
+    default:
+      break;
     }
 
-    struct Expr *new = malloc(sizeof(*new));
+    int precedence = precedences[kind];
 
-    *new = (struct Expr){.kind = E_BINOP, .binop = {op, lhs, rhs}};
+    if (precedence == 0) {
+      goto end;
+    }
 
-    lhs = new;
+    // assignment is right assoc so it doesn't apply an equal one before it
+    reduce(pending_base, precedence == ASSIGN_PRECEDENCE ? precedence + 1
+                                                         : precedence);
 
-    cur_precedence = next_precedence;
+    push_pending((struct Pending){
+        .kind = P_BINOP, .precedence = precedence, .op = operators[kind]});
+    read_token();
+    goto operand;
   }
 
-  if (cur_token.kind == ASSIGN) {
-    eat_token(ASSIGN);
+end:
+  reduce(pending_base, 0);
+  bracket = open_bracket(pending_base);
 
-    struct Expr *new = malloc(sizeof(*new));
-    struct Expr *rhs = match_expr();
+  if (bracket) {
+    char expected = bracket->kind == P_INDEX  ? ']'
+                    : bracket->kind == P_COND ? ':'
+                                              : ')';
 
-    *new = (struct Expr){.kind = E_BINOP, .binop = {O_ASSIGN, lhs, rhs}};
-
-    lhs = new;
+    error_printf("Syntax error: Expected '%c' in expression, found %s\n",
+                 expected, token_repr[cur_token.kind]);
+    FAIL;
   }
 
-  return lhs;
-}
+  n_operands = operand_base;
 
-struct Expr *match_expr() {
-  // assignment is an expression
-  //
-  // expr ::=
-  //   | `prefix-op` expr
-  //   | expr `op` expr
-  //   | lvalue = expr
-  //     - special case of `op`
-  //     - this is the only right assoc operator
-  //     - parse everything right of = as the rhs expr
-  // can do operator precedence parsing
-
-  struct Expr *primary = match_primary_expr();
-  struct Expr *expr = match_expr_op(primary, 0);
-
-  return expr;
+  return operands[operand_base];
 }
 
+// expression including the comma operator
+struct Expr *match_expr() { return match_expr_with(1); }
+
+// expression without a comma operator at the top, for initializers
+struct Expr *match_assign_expr() { return match_expr_with(0); }
+
 // probably need different functions and structs for int/string
 // const initializers for structs/arrays?
 void *match_constructor() {
@@ -889,7 +1190,7 @@ struct Stmt *match_stmt() {
 
     stmt.if_stmt.if_block = match_stmt();
 
-    if (read_token().kind == ELSE) {
+    if (cur_token.kind == ELSE) {
       eat_token(ELSE);
       stmt.if_stmt.else_block = match_stmt();
     }
@@ -912,13 +1213,18 @@ struct Stmt *match_stmt() {
   case ENUM:
     goto dec;
 
-  // brackets or unary operators
-  // TODO ! ~
+  // brackets, constants or unary operators
   case L_PAREN:
+  case INTEGER:
+  case SIZEOF:
   case AMP:
   case STAR:
   case PLUS:
   case MINUS:
+  case NOT:
+  case TILDE:
+  case INC:
+  case DEC:
     goto expr;
 
   // jump statements
@@ -943,11 +1249,12 @@ struct Stmt *match_stmt() {
   case IDENT:;
     // check if this is type or not
     // TODO labels
-    struct Symbol *symbol = lookup_symbol(cur_token.identifier);
+    struct Symbol *symbol = lookup_symbol(cur_token.ident);
 
     if (!symbol) {
       // TODO this can be a label
-      printf("Semantic error: undefined symbol %s\n", cur_token.identifier);
+      error_printf("Semantic error: undefined symbol %s\n",
+                   intern_str(cur_token.ident));
       FAIL;
     }
 
@@ -957,8 +1264,8 @@ struct Stmt *match_stmt() {
       goto expr;
     }
   default:
-    printf("Syntax error: Unexpected token '%s' in statement\n",
-           token_repr[cur_token.kind]);
+    error_printf("Syntax error: Unexpected token '%s' in statement\n",
+                 token_repr[cur_token.kind]);
     FAIL;
   }
 
@@ -966,19 +1273,19 @@ struct Stmt *match_stmt() {
   FAIL;
 
 dec:;
-  struct Type type = match_type();
+  struct Type *type = match_type();
   struct Dec dec = match_declarator(type);
 
   struct Var *var = add_local(dec.identifier, dec.type);
 
   if (cur_token.kind == '=') {
     eat_token('=');
-    struct Expr *rval = match_expr();
-    struct Expr *assign = malloc(sizeof(*assign));
+    struct Expr *rval = match_assign_expr();
+    struct Expr *assign = lasting_alloc(sizeof(*assign));
     assign->kind = E_BINOP;
     assign->binop.op = O_ASSIGN;
     assign->binop.r = rval;
-    assign->binop.l = malloc(sizeof(*assign->binop.l));
+    assign->binop.l = lasting_alloc(sizeof(*assign->binop.l));
     assign->binop.l->kind = E_VAR;
     assign->binop.l->var = var;
 
@@ -1003,7 +1310,7 @@ expr:;
   goto complete;
 
 complete:;
-  struct Stmt *stmt_ptr = malloc(sizeof(*stmt_ptr));
+  struct Stmt *stmt_ptr = lasting_alloc(sizeof(*stmt_ptr));
   *stmt_ptr = stmt;
 
   return stmt_ptr;
@@ -1024,7 +1331,7 @@ struct BlockStmt *match_block_stmt() {
     if (stmt == NULL)
       continue;
 
-    *tail = malloc(sizeof(**tail));
+    *tail = lasting_alloc(sizeof(**tail));
 
     (*tail)->stmt = stmt;
     (*tail)->next = NULL;
@@ -1038,11 +1345,239 @@ struct BlockStmt *match_block_stmt() {
   return block;
 }
 
+// two phase parsing of big files
+// a skim defines everything at file scope and only notes where each function
+// body is, skipping it by matching braces, then the bodies are parsed by a
+// pool of threads
+// a body sees the file scope as it was where the body is, see visible_pos,
+// so the result is the same as parsing in order
+//
+// errors are recorded instead of reported until it is known which one comes
+// first in the file, then only that one is reported
+
+#define MIN_PARALLEL_TOKENS (1 << 16)
+#define MAX_JOBS 64
+
+int parse_jobs = 0;
+
+// a body that was skipped
+struct Body {
+  struct Func *func;
+  int start; // token position of the {
+  int failed;
+  struct Error error; // set if failed
+};
+
+struct BodyList {
+  struct Body *bodies;
+  int len;
+  int cap;
+};
+
+void push_body(struct BodyList *list, struct Body body) {
+  if (list->len == list->cap) {
+    list->cap = list->cap ? 2 * list->cap : 64;
+    list->bodies = realloc(list->bodies, list->cap * sizeof(*list->bodies));
+  }
+
+  list->bodies[list->len++] = body;
+}
+
+struct BodyList skimmed; // in order
+int next_body = 0;       // next skimmed body for a worker to take
+
+int lazy_bodies = 0;
+
+// the body of def is skipped, either to be parsed by a worker after the skim
+// or, when parsing lazily, once it is needed
+void skip_body(struct Func *def, struct Param *params, int n_params) {
+  int start = save_tokens();
+
+  // params are in declarator_arena which is reset by the next declaration
+  def->params = lasting_copy(params, n_params * sizeof(*params));
+  def->n_params = n_params;
+
+  if (skimming) {
+    push_body(&skimmed, (struct Body){.func = def, .start = start});
+  } else {
+    def->body_pos = start;
+  }
+
+  // an unclosed body runs to the end, parsing it gives the error
+  int pos = start;
+  int depth = 0;
+
+  do {
+    depth += tokens[pos].kind == '{';
+    depth -= tokens[pos].kind == '}';
+    pos++;
+  } while (depth > 0 && pos < n_tokens - 1);
+
+  restore_tokens(pos);
+}
+
+void parse_body(struct Body *body) {
+  arena_reset(&declarator_arena);
+  visible_pos = body->start;
+  restore_tokens(body->start);
+
+  match_body(body->func, body->func->params, body->func->n_params);
+
+  visible_pos = INT_MAX;
+}
+
+// clean up after an error jumped out of parsing
+void abandon_parse() {
+  release_types();
+  drop_scopes();
+  n_operands = 0;
+  n_pending = 0;
+  visible_pos = INT_MAX;
+}
+
+// take bodies until there are none left
+void parse_bodies() {
+  jmp_buf bail;
+
+  fail_jump = &bail;
+
+  while (1) {
+    int i = __atomic_fetch_add(&next_body, 1, __ATOMIC_RELAXED);
+
+    if (i >= skimmed.len) {
+      break;
+    }
+
+    if (setjmp(bail)) {
+      skimmed.bodies[i].failed = 1;
+      skimmed.bodies[i].error = caught_error;
+      abandon_parse();
+      continue;
+    }
+
+    parse_body(&skimmed.bodies[i]);
+  }
+
+  fail_jump = NULL;
+}
+
+void *body_worker(void *arg) {
+  (void)arg;
+  parse_bodies();
+
+  // thread locals go with the thread, apart from ast_arena which holds the
+  // bodies
+  free_scopes();
+  free_type_buffers();
+  arena_free(&declarator_arena);
+  free(operands);
+  free(pending);
+
+  return NULL;
+}
+
+void parse_parallel(int jobs) {
+  // the error the skim stopped on, if it failed
+  int skim_failed = 0;
+  struct Error skim_error;
+  jmp_buf bail;
+
+  fail_jump = &bail;
+  skimming = 1;
+
+  if (setjmp(bail)) {
+    skim_failed = 1;
+    skim_error = caught_error;
+    abandon_parse();
+  } else {
+    while (cur_token.kind != END) {
+      match_outer_dec();
+    }
+  }
+
+  fail_jump = NULL;
+  skimming = 0;
+
+  pthread_t threads[MAX_JOBS];
+
+  for (int i = 1; i < jobs; i++) {
+    pthread_create(&threads[i], NULL, body_worker, NULL);
+  }
+
+  parse_bodies();
+
+  for (int i = 1; i < jobs; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // bodies are in order and all come before where the skim stopped
+  for (int i = 0; i < skimmed.len; i++) {
+    if (skimmed.bodies[i].failed) {
+      report_error(&skimmed.bodies[i].error);
+    }
+  }
+
+  if (skim_failed) {
+    report_error(&skim_error);
+  }
+
+  free(skimmed.bodies);
+  skimmed = (struct BodyList){0};
+  next_body = 0;
+}
+
 // parse start_symbol
 void parse() {
   setup_lexer();
 
+  int jobs = parse_jobs;
+
+  if (jobs == 0) {
+    jobs = n_tokens < MIN_PARALLEL_TOKENS ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  if (jobs > MAX_JOBS) {
+    jobs = MAX_JOBS;
+  }
+
+  if (jobs > 1 && !lazy_bodies) {
+    parse_parallel(jobs);
+    return;
+  }
+
   while (cur_token.kind != END) {
     match_outer_dec();
   }
 }
+
+// lazy parsing
+// bodies are skipped like in a skim and only parsed once something needs
+// them, a use in another body or a call to func_body, so a function that
+// nothing uses costs a brace scan
+// a body is parsed after the whole file, so it gets the file scope it would
+// have seen in place the same way as in parallel parsing
+
+// bodies needed but not parsed yet
+struct BodyList wanted;
+
+void need_body(struct Func *func) {
+  if (func->body_pos) {
+    push_body(&wanted, (struct Body){.func = func, .start = func->body_pos});
+    func->body_pos = 0;
+  }
+}
+
+struct BlockStmt *func_body(struct Func *func) {
+  int pos = save_tokens();
+
+  need_body(func);
+
+  // bodies needed by the ones being parsed are added as they are found
+  while (wanted.len) {
+    struct Body body = wanted.bodies[--wanted.len];
+    parse_body(&body);
+  }
+
+  restore_tokens(pos);
+  return func->stmt;
+}
@@ -1,8 +1,22 @@
 #ifndef PARSER_HEADER
 #define PARSER_HEADER
 
+#include "ast.h"
+#include "symbols.h"
+
 void parse();
 
+// threads parsing function bodies, 1 parses in order
+// 0 uses every processor for big files
+extern int parse_jobs;
+
+// only parse function bodies once they are needed, see func_body
+extern int lazy_bodies;
+
+// body of a defined function, parsed now if it was skipped along with the
+// bodies it uses
+struct BlockStmt *func_body(struct Func *func);
+
 struct Expr *match_expr();
 
 #endif
@@ -0,0 +1,759 @@
+// precompiled headers
+// a header is parsed once and its global symbols, structs and macros are
+// written out, so files that include it can load them instead of parsing
+// the header again
+//
+// the file is mapped and used in place. types, structs, fields, function
+// signatures and params keep their in-memory layout, with pointers stored
+// as offsets into the file that are fixed up when it is loaded. names are
+// stored as offsets of strings and interned again when it is loaded
+//
+// every file that went into the header is recorded with a hash of its
+// contents, and the header is refused if any of them have changed
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "intern.h"
+#include "lexer.h"
+#include "pch.h"
+#include "preprocessor.h"
+#include "source.h"
+#include "symbols.h"
+#include "types.h"
+
+#define PCH_MAGIC "c89-pch1"
+
+enum Section {
+  SEC_FILES,
+  SEC_TYPES,
+  SEC_STRUCTS,
+  SEC_FIELDS,
+  SEC_SIGS,
+  SEC_PARAMS,
+  SEC_SYMBOLS,
+  SEC_STRUCT_NAMES,
+  SEC_MACROS,
+  SEC_PARAM_NAMES,
+  SEC_TOKENS,
+  SEC_STRINGS,
+  N_SECTIONS
+};
+
+struct PchFile {
+  unsigned long path; // offset in SEC_STRINGS
+  unsigned long hash;
+  unsigned long len;
+
+  // locations in macros are for the files laid end to end in this order
+  unsigned long base;
+};
+
+struct PchSymbol {
+  unsigned int name;
+  int kind;
+  unsigned long ref; // type for typedefs and globals, signature for functions
+  int complete;
+};
+
+struct PchStruct {
+  unsigned int name;
+  unsigned long ref;
+};
+
+struct PchMacro {
+  unsigned int name;
+  unsigned int loc;
+  int function_like;
+  int n_params;
+  unsigned long params; // index in SEC_PARAM_NAMES
+  unsigned long body;   // index in SEC_TOKENS
+  int body_len;
+};
+
+long record_sizes[N_SECTIONS] = {
+    [SEC_FILES] = sizeof(struct PchFile),
+    [SEC_TYPES] = sizeof(struct Type),
+    [SEC_STRUCTS] = sizeof(struct Struct),
+    [SEC_FIELDS] = sizeof(struct Field),
+    [SEC_SIGS] = sizeof(struct FuncSig),
+    [SEC_PARAMS] = sizeof(struct Param),
+    [SEC_SYMBOLS] = sizeof(struct PchSymbol),
+    [SEC_STRUCT_NAMES] = sizeof(struct PchStruct),
+    [SEC_MACROS] = sizeof(struct PchMacro),
+    [SEC_PARAM_NAMES] = sizeof(unsigned int),
+    [SEC_TOKENS] = sizeof(struct Token),
+    [SEC_STRINGS] = 1,
+};
+
+struct PchHeader {
+  char magic[8];
+
+  // a file written by a build with different layouts can't be used
+  long record_sizes[N_SECTIONS];
+
+  unsigned long offsets[N_SECTIONS];
+  unsigned long counts[N_SECTIONS];
+};
+
+unsigned long hash_source(struct Source *src) {
+  unsigned long hash = 14695981039346656037ul;
+
+  for (long i = 0; i < src->len; i++) {
+    hash ^= (unsigned char)src->buf[i];
+    hash *= 1099511628211ul;
+  }
+
+  return hash;
+}
+
+void pch_error(char *message, char *path) {
+  printf("Error: %s %s\n", message, path);
+  exit(2);
+}
+
+// writing
+
+// everything that goes in each section
+void **objects[N_SECTIONS];
+unsigned long n_objects[N_SECTIONS];
+unsigned long objects_cap[N_SECTIONS];
+
+// where each object in the type graph went, open addressed by pointer
+struct Placed {
+  void *ptr;
+  enum Section section;
+  unsigned long index;
+} *placed = NULL;
+
+unsigned long placed_cap = 0;
+unsigned long n_placed = 0;
+
+unsigned long offsets[N_SECTIONS];
+
+struct Placed *find_placed(void *ptr) {
+  unsigned long i = ((unsigned long)ptr >> 4) * 0x9E3779B97F4A7C15ul;
+
+  for (;; i++) {
+    struct Placed *slot = &placed[i & (placed_cap - 1)];
+
+    if (slot->ptr == ptr || slot->ptr == NULL) {
+      return slot;
+    }
+  }
+}
+
+void push_object(enum Section section, void *ptr) {
+  if (n_objects[section] == objects_cap[section]) {
+    objects_cap[section] = objects_cap[section] ? objects_cap[section] * 2 : 64;
+    objects[section] =
+        realloc(objects[section], objects_cap[section] * sizeof(void *));
+  }
+
+  objects[section][n_objects[section]++] = ptr;
+}
+
+// returns 0 if ptr has been added already
+int add_object(enum Section section, void *ptr) {
+  if (n_placed * 2 >= placed_cap) {
+    struct Placed *old = placed;
+    unsigned long old_cap = placed_cap;
+
+    placed_cap = placed_cap ? placed_cap * 2 : 1024;
+    placed = calloc(placed_cap, sizeof(*placed));
+
+    for (unsigned long i = 0; i < old_cap; i++) {
+      if (old[i].ptr) {
+        *find_placed(old[i].ptr) = old[i];
+      }
+    }
+
+    free(old);
+  }
+
+  struct Placed *slot = find_placed(ptr);
+
+  if (slot->ptr) {
+    return 0;
+  }
+
+  *slot = (struct Placed){ptr, section, n_objects[section]};
+  n_placed++;
+  push_object(section, ptr);
+  return 1;
+}
+
+// file offset of an object that has been added, 0 for NULL
+void *ref(void *ptr) {
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  struct Placed *slot = find_placed(ptr);
+  return (void *)(offsets[slot->section] +
+                  slot->index * record_sizes[slot->section]);
+}
+
+char *strings = NULL;
+unsigned long strings_len = 0;
+unsigned long strings_cap = 0;
+
+// offsets of interned names that have been written, by id
+unsigned int *name_refs = NULL;
+unsigned int name_refs_cap = 0;
+
+unsigned long add_string(const char *str) {
+  unsigned long len = strlen(str) + 1;
+
+  if (strings_len + len > strings_cap) {
+    strings_cap = strings_cap ? strings_cap * 2 : 4096;
+
+    while (strings_len + len > strings_cap) {
+      strings_cap *= 2;
+    }
+
+    strings = realloc(strings, strings_cap);
+  }
+
+  memcpy(strings + strings_len, str, len);
+  strings_len += len;
+  return strings_len - len;
+}
+
+// offset 0 is the empty string, which stands for no name
+unsigned int name_ref(unsigned int name) {
+  if (name == 0) {
+    return 0;
+  }
+
+  if (name >= name_refs_cap) {
+    unsigned int cap = name_refs_cap ? name_refs_cap : 256;
+
+    while (cap <= name) {
+      cap *= 2;
+    }
+
+    name_refs = realloc(name_refs, cap * sizeof(*name_refs));
+    memset(name_refs + name_refs_cap, 0,
+           (cap - name_refs_cap) * sizeof(*name_refs));
+    name_refs_cap = cap;
+  }
+
+  if (name_refs[name] == 0) {
+    name_refs[name] = add_string(intern_str(name));
+  }
+
+  return name_refs[name];
+}
+
+void collect_type(struct Type *type);
+
+void collect_sig(struct FuncSig *sig) {
+  if (!add_object(SEC_SIGS, sig)) {
+    return;
+  }
+
+  collect_type(sig->ret);
+
+  // the array is added before anything else so it stays contiguous
+  for (int i = 0; i < sig->n_params; i++) {
+    add_object(SEC_PARAMS, &sig->params[i]);
+  }
+
+  for (int i = 0; i < sig->n_params; i++) {
+    collect_type(sig->params[i].type);
+  }
+}
+
+void collect_struct(struct Struct *struc) {
+  if (!add_object(SEC_STRUCTS, struc)) {
+    return;
+  }
+
+  for (int i = 0; i < struc->n_fields; i++) {
+    add_object(SEC_FIELDS, &struc->fields[i]);
+  }
+
+  for (int i = 0; i < struc->n_fields; i++) {
+    collect_type(struc->fields[i].type);
+  }
+}
+
+void collect_type(struct Type *type) {
+  if (type == NULL || !add_object(SEC_TYPES, type)) {
+    return;
+  }
+
+  switch (type->kind) {
+  case T_POINTER:
+  case T_ARRAY:
+    collect_type(type->ptr_type);
+    break;
+  case T_STRUCT:
+  case T_UNION:
+    // unions have the same layout as structs
+    collect_struct(type->struct_type);
+    break;
+  case T_FUNC:
+    collect_sig(type->func_sig);
+    break;
+  default:
+    break;
+  }
+}
+
+// global symbols and structs, with the names they are under
+unsigned int *symbol_names = NULL;
+unsigned int *struct_names = NULL;
+
+void collect_symbol(unsigned int name, struct Symbol *sym) {
+  switch (sym->kind) {
+  case S_TYPEDEF:
+    collect_type(sym->type);
+    break;
+  case S_GLOBAL:
+    collect_type(sym->global->type);
+    break;
+  case S_FUNC:
+    if (sym->func->complete) {
+      pch_error("only declarations can be precompiled, found a body for",
+                intern_str(name));
+    }
+
+    collect_sig(sym->func->sig);
+    break;
+  default:
+    pch_error("can't precompile symbol", intern_str(name));
+  }
+
+  symbol_names = realloc(symbol_names,
+                         (n_objects[SEC_SYMBOLS] + 1) * sizeof(unsigned int));
+  symbol_names[n_objects[SEC_SYMBOLS]] = name;
+  push_object(SEC_SYMBOLS, sym);
+}
+
+void collect_struct_name(unsigned int name, struct Struct *struc) {
+  collect_struct(struc);
+
+  struct_names = realloc(
+      struct_names, (n_objects[SEC_STRUCT_NAMES] + 1) * sizeof(unsigned int));
+  struct_names[n_objects[SEC_STRUCT_NAMES]] = name;
+  push_object(SEC_STRUCT_NAMES, struc);
+}
+
+void collect_macro(struct Macro *macro) {
+  push_object(SEC_MACROS, macro);
+  n_objects[SEC_PARAM_NAMES] += macro->n_params;
+  n_objects[SEC_TOKENS] += macro->body_len;
+}
+
+// the header comes first, then everything it included
+struct Source **files = NULL;
+
+void collect_file(char *path, struct Source *src) {
+  files = realloc(files, (n_objects[SEC_FILES] + 1) * sizeof(*files));
+  files[n_objects[SEC_FILES]] = src;
+  push_object(SEC_FILES, path);
+}
+
+unsigned long *file_bases = NULL;
+
+unsigned int pch_loc(unsigned int loc) {
+  for (unsigned long i = 0; i < n_objects[SEC_FILES]; i++) {
+    if (loc >= files[i]->base && loc <= files[i]->base + files[i]->len) {
+      return file_bases[i] + (loc - files[i]->base);
+    }
+  }
+
+  pch_error("can't precompile a macro from outside of", files[0]->name);
+  return 0;
+}
+
+struct Token pch_token(struct Token token) {
+  token.loc = pch_loc(token.loc);
+
+  if (token.kind == IDENT) {
+    token.ident = name_ref(token.ident);
+  } else if (token.kind == STRING) {
+    token.str_literal.loc = pch_loc(token.str_literal.loc);
+  }
+
+  return token;
+}
+
+void write_pch(char *path, struct Source *header) {
+  char *real = realpath(header->name, NULL);
+
+  if (real == NULL) {
+    pch_error("can't precompile", header->name);
+  }
+
+  add_string("");
+  collect_file(real, header);
+  visit_files(collect_file);
+  visit_globals(collect_symbol, collect_struct_name);
+  visit_macros(collect_macro);
+
+  file_bases = malloc(n_objects[SEC_FILES] * sizeof(*file_bases));
+  unsigned long base = 0;
+
+  for (unsigned long i = 0; i < n_objects[SEC_FILES]; i++) {
+    file_bases[i] = base;
+    base += files[i]->len + 1;
+  }
+
+  // names are only added to the strings while writing the records, so the
+  // strings go last and are written separately
+  struct PchHeader pch_header;
+  unsigned long size = sizeof(pch_header);
+
+  memcpy(pch_header.magic, PCH_MAGIC, sizeof(pch_header.magic));
+
+  for (int i = 0; i < SEC_STRINGS; i++) {
+    size = (size + 15) & ~15ul;
+    offsets[i] = size;
+    size += n_objects[i] * record_sizes[i];
+  }
+
+  char *out = calloc(1, size);
+
+  for (unsigned long i = 0; i < n_objects[SEC_FILES]; i++) {
+    struct PchFile *file = (struct PchFile *)(out + offsets[SEC_FILES]) + i;
+    *file = (struct PchFile){add_string(objects[SEC_FILES][i]),
+                             hash_source(files[i]), files[i]->len,
+                             file_bases[i]};
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_TYPES]; i++) {
+    struct Type *type = (void *)(out + offsets[SEC_TYPES]);
+    struct Type *from = objects[SEC_TYPES][i];
+
+    type[i] = *from;
+
+    switch (from->kind) {
+    case T_POINTER:
+    case T_ARRAY:
+      type[i].ptr_type = ref(from->ptr_type);
+      break;
+    case T_STRUCT:
+    case T_UNION:
+      type[i].struct_type = ref(from->struct_type);
+      break;
+    case T_FUNC:
+      type[i].func_sig = ref(from->func_sig);
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_STRUCTS]; i++) {
+    struct Struct *struc = (void *)(out + offsets[SEC_STRUCTS]);
+    struct Struct *from = objects[SEC_STRUCTS][i];
+
+    struc[i] = *from;
+    struc[i].name = name_ref(from->name);
+    struc[i].fields = ref(from->fields);
+    // member tables are built again when they are used
+    struc[i].members = NULL;
+    struc[i].members_cap = 0;
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_FIELDS]; i++) {
+    struct Field *field = (void *)(out + offsets[SEC_FIELDS]);
+    struct Field *from = objects[SEC_FIELDS][i];
+
+    field[i] = *from;
+    field[i].name = name_ref(from->name);
+    field[i].type = ref(from->type);
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_SIGS]; i++) {
+    struct FuncSig *sig = (void *)(out + offsets[SEC_SIGS]);
+    struct FuncSig *from = objects[SEC_SIGS][i];
+
+    sig[i] = (struct FuncSig){ref(from->ret), ref(from->params),
+                              from->n_params};
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_PARAMS]; i++) {
+    struct Param *param = (void *)(out + offsets[SEC_PARAMS]);
+    struct Param *from = objects[SEC_PARAMS][i];
+
+    param[i] = (struct Param){name_ref(from->name), ref(from->type)};
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_SYMBOLS]; i++) {
+    struct PchSymbol *symbol = (void *)(out + offsets[SEC_SYMBOLS]);
+    struct Symbol *from = objects[SEC_SYMBOLS][i];
+
+    symbol[i] = (struct PchSymbol){name_ref(symbol_names[i]), from->kind,
+                                   0, 0};
+
+    if (from->kind == S_TYPEDEF) {
+      symbol[i].ref = (unsigned long)ref(from->type);
+    } else if (from->kind == S_GLOBAL) {
+      symbol[i].ref = (unsigned long)ref(from->global->type);
+      symbol[i].complete = from->global->complete;
+    } else {
+      symbol[i].ref = (unsigned long)ref(from->func->sig);
+    }
+  }
+
+  for (unsigned long i = 0; i < n_objects[SEC_STRUCT_NAMES]; i++) {
+    struct PchStruct *struc = (void *)(out + offsets[SEC_STRUCT_NAMES]);
+
+    struc[i] = (struct PchStruct){
+        name_ref(struct_names[i]),
+        (unsigned long)ref(objects[SEC_STRUCT_NAMES][i])};
+  }
+
+  struct PchMacro *macro = (void *)(out + offsets[SEC_MACROS]);
+  unsigned int *param_name = (void *)(out + offsets[SEC_PARAM_NAMES]);
+  struct Token *token = (void *)(out + offsets[SEC_TOKENS]);
+  unsigned long n_params = 0, n_tokens = 0;
+
+  for (unsigned long i = 0; i < n_objects[SEC_MACROS]; i++) {
+    struct Macro *from = objects[SEC_MACROS][i];
+
+    macro[i] = (struct PchMacro){name_ref(from->name), pch_loc(from->loc),
+                                 from->function_like, from->n_params,
+                                 n_params, n_tokens, from->body_len};
+
+    for (int j = 0; j < from->n_params; j++) {
+      param_name[n_params++] = name_ref(from->params[j]);
+    }
+
+    for (int j = 0; j < from->body_len; j++) {
+      token[n_tokens++] = pch_token(from->body[j]);
+    }
+  }
+
+  offsets[SEC_STRINGS] = (size + 15) & ~15ul;
+  n_objects[SEC_STRINGS] = strings_len;
+
+  memcpy(pch_header.record_sizes, record_sizes, sizeof(record_sizes));
+  memcpy(pch_header.offsets, offsets, sizeof(offsets));
+  memcpy(pch_header.counts, n_objects, sizeof(n_objects));
+  memcpy(out, &pch_header, sizeof(pch_header));
+
+  FILE *file = fopen(path, "wb");
+
+  if (file == NULL) {
+    pch_error("couldn't write", path);
+  }
+
+  fwrite(out, 1, size, file);
+
+  for (unsigned long pad = size; pad < offsets[SEC_STRINGS]; pad++) {
+    fputc(0, file);
+  }
+
+  fwrite(strings, 1, strings_len, file);
+  fclose(file);
+
+  free(out);
+  free(real);
+}
+
+// loading
+
+char *pch_base;
+struct PchHeader *pch;
+
+// fix a pointer stored as an offset
+#define FIX(ptr)                                                               \
+  ((ptr) = (ptr) ? (void *)(pch_base + (unsigned long)(ptr)) : NULL)
+
+void *section_start(enum Section section) {
+  return pch_base + pch->offsets[section];
+}
+
+unsigned int load_name(unsigned int ref) {
+  if (ref == 0) {
+    return 0;
+  }
+
+  char *str = (char *)section_start(SEC_STRINGS) + ref;
+  return intern(str, strlen(str));
+}
+
+// where each file's locations start now
+unsigned int *load_bases;
+
+unsigned int load_loc(unsigned int loc) {
+  struct PchFile *file = section_start(SEC_FILES);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_FILES]; i++) {
+    if (loc >= file[i].base && loc <= file[i].base + file[i].len) {
+      return load_bases[i] + (loc - file[i].base);
+    }
+  }
+
+  return NO_LOC;
+}
+
+void load_macros() {
+  struct PchMacro *macro = section_start(SEC_MACROS);
+  unsigned int *param_names = section_start(SEC_PARAM_NAMES);
+  struct Token *tokens = section_start(SEC_TOKENS);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_MACROS]; i++) {
+    // macros are copied out so #undef can free them
+    struct Macro *def = calloc(1, sizeof(*def));
+
+    def->name = load_name(macro[i].name);
+    def->loc = load_loc(macro[i].loc);
+    def->function_like = macro[i].function_like;
+    def->n_params = macro[i].n_params;
+    def->params = malloc(def->n_params * sizeof(unsigned int));
+    def->body_len = macro[i].body_len;
+    def->body = malloc(def->body_len * sizeof(struct Token));
+
+    for (int j = 0; j < def->n_params; j++) {
+      def->params[j] = load_name(param_names[macro[i].params + j]);
+    }
+
+    for (int j = 0; j < def->body_len; j++) {
+      struct Token token = tokens[macro[i].body + j];
+      token.loc = load_loc(token.loc);
+
+      if (token.kind == IDENT) {
+        token.ident = load_name(token.ident);
+      } else if (token.kind == STRING) {
+        token.str_literal.loc = load_loc(token.str_literal.loc);
+      }
+
+      def->body[j] = token;
+    }
+
+    define_macro(def);
+  }
+}
+
+void load_pch(char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    pch_error("couldn't open precompiled header", path);
+  }
+
+  // private so pointers can be fixed up in place
+  pch_base = st.st_size < (long)sizeof(*pch)
+                 ? MAP_FAILED
+                 : mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+  close(fd);
+
+  pch = (void *)pch_base;
+
+  if (pch_base == MAP_FAILED || memcmp(pch->magic, PCH_MAGIC, 8) ||
+      memcmp(pch->record_sizes, record_sizes, sizeof(record_sizes))) {
+    pch_error("not a precompiled header for this compiler:", path);
+  }
+
+  // the files it was made from must be the same, and aren't included again
+  struct PchFile *file = section_start(SEC_FILES);
+  load_bases = malloc(pch->counts[SEC_FILES] * sizeof(*load_bases));
+
+  for (unsigned long i = 0; i < pch->counts[SEC_FILES]; i++) {
+    char *name = (char *)section_start(SEC_STRINGS) + file[i].path;
+    struct Source *src = precompiled_file(name);
+
+    if (src == NULL || (unsigned long)src->len != file[i].len ||
+        hash_source(src) != file[i].hash) {
+      pch_error("precompiled header is out of date, changed file:", name);
+    }
+
+    load_bases[i] = src->base;
+  }
+
+  struct Type *type = section_start(SEC_TYPES);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_TYPES]; i++) {
+    switch (type[i].kind) {
+    case T_POINTER:
+    case T_ARRAY:
+      FIX(type[i].ptr_type);
+      break;
+    case T_STRUCT:
+    case T_UNION:
+      FIX(type[i].struct_type);
+      break;
+    case T_FUNC:
+      FIX(type[i].func_sig);
+      break;
+    default:
+      break;
+    }
+  }
+
+  struct Struct *struc = section_start(SEC_STRUCTS);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_STRUCTS]; i++) {
+    struc[i].name = load_name(struc[i].name);
+    FIX(struc[i].fields);
+  }
+
+  struct Field *field = section_start(SEC_FIELDS);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_FIELDS]; i++) {
+    field[i].name = load_name(field[i].name);
+    FIX(field[i].type);
+  }
+
+  struct FuncSig *sig = section_start(SEC_SIGS);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_SIGS]; i++) {
+    FIX(sig[i].ret);
+    FIX(sig[i].params);
+  }
+
+  struct Param *param = section_start(SEC_PARAMS);
+
+  for (unsigned long i = 0; i < pch->counts[SEC_PARAMS]; i++) {
+    param[i].name = load_name(param[i].name);
+    FIX(param[i].type);
+  }
+
+  // types are shared with the rest of the compile through the canonical table
+  // this can only be done once every pointer is fixed
+  for (unsigned long i = 0; i < pch->counts[SEC_FIELDS]; i++) {
+    field[i].type = canon_type(field[i].type);
+  }
+
+  struct PchStruct *struct_name = section_start(SEC_STRUCT_NAMES);
+
+  // the tables were walked newest first, add them back oldest first
+  for (unsigned long i = pch->counts[SEC_STRUCT_NAMES]; i-- > 0;) {
+    define_struct(load_name(struct_name[i].name),
+                  (void *)(pch_base + struct_name[i].ref));
+  }
+
+  struct PchSymbol *symbol = section_start(SEC_SYMBOLS);
+
+  for (unsigned long i = pch->counts[SEC_SYMBOLS]; i-- > 0;) {
+    unsigned int name = load_name(symbol[i].name);
+    void *ref = pch_base + symbol[i].ref;
+
+    if (symbol[i].kind == S_TYPEDEF) {
+      struct Symbol *sym = add_symbol(name);
+      sym->kind = S_TYPEDEF;
+      sym->type = canon_type(ref);
+    } else if (symbol[i].kind == S_GLOBAL) {
+      struct Global *global = add_global(name);
+      global->type = canon_type(ref);
+      global->complete = symbol[i].complete;
+    } else {
+      struct Type func = {.kind = T_FUNC, .func_sig = ref};
+      add_func(name)->sig = canon_type(&func)->func_sig;
+    }
+  }
+
+  load_macros();
+}
@@ -0,0 +1,15 @@
+#ifndef PCH_HEADER
+#define PCH_HEADER
+
+#include "source.h"
+
+// precompiled headers
+// after parsing a header, write its global symbols, structs and macros
+void write_pch(char *path, struct Source *header);
+
+// load a precompiled header before parsing
+// the files it was made from must not have changed, and are skipped when
+// they are included
+void load_pch(char *path);
+
+#endif
@@ -0,0 +1,1601 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "fail.h"
+#include "intern.h"
+#include "lexer.h"
+#include "preprocessor.h"
+#include "source.h"
+
+// directives are identifiers except for if and else which lex as keywords
+enum Directive {
+  D_INCLUDE,
+  D_DEFINE,
+  D_UNDEF,
+  D_IFDEF,
+  D_IFNDEF,
+  D_ELIF,
+  D_ENDIF,
+  D_ERROR,
+  D_PRAGMA,
+  D_LINE,
+  N_DIRECTIVES
+};
+
+char *directive_names[N_DIRECTIVES] = {
+    [D_INCLUDE] = "include", [D_DEFINE] = "define", [D_UNDEF] = "undef",
+    [D_IFDEF] = "ifdef",     [D_IFNDEF] = "ifndef", [D_ELIF] = "elif",
+    [D_ENDIF] = "endif",     [D_ERROR] = "error",   [D_PRAGMA] = "pragma",
+    [D_LINE] = "line",
+};
+
+unsigned int directive_ids[N_DIRECTIVES];
+unsigned int defined_id;
+
+// macros by the interned id of their name, NULL if not defined
+struct Macro **macros = NULL;
+unsigned int macros_cap = 0;
+
+struct Macro *lookup_macro(unsigned int name) {
+  return name < macros_cap ? macros[name] : NULL;
+}
+
+void free_macro(struct Macro *macro) {
+  free(macro->params);
+  free(macro->body);
+  free(macro);
+}
+
+void define_macro(struct Macro *macro) {
+  unsigned int name = macro->name;
+
+  if (name >= macros_cap) {
+    unsigned int cap = macros_cap ? macros_cap : 256;
+
+    while (cap <= name) {
+      cap *= 2;
+    }
+
+    macros = realloc(macros, cap * sizeof(*macros));
+    memset(macros + macros_cap, 0, (cap - macros_cap) * sizeof(*macros));
+    macros_cap = cap;
+  }
+
+  if (macros[name]) {
+    free_macro(macros[name]);
+  }
+
+  macros[name] = macro;
+}
+
+void visit_macros(void (*visit)(struct Macro *macro)) {
+  for (unsigned int i = 0; i < macros_cap; i++) {
+    if (macros[i]) {
+      visit(macros[i]);
+    }
+  }
+}
+
+void setup_preprocessor() {
+  for (int i = 0; i < N_DIRECTIVES; i++) {
+    directive_ids[i] =
+        intern(directive_names[i], strlen(directive_names[i]));
+  }
+
+  defined_id = intern("defined", 7);
+}
+
+void pp_error(unsigned int loc) {
+  fail_loc = loc;
+  FAIL;
+}
+
+// files found by #include, cached for the whole run
+// every path that has been tried is kept, including ones that don't exist,
+// so including the same name again doesn't touch the file system
+struct File {
+  char *path; // real path
+  struct Source *source;
+
+  // macro guarding the whole file, 0 if there isn't one
+  // the file is skipped without being looked at if this is defined
+  unsigned int guard;
+
+  // already read from a precompiled header, it is never included
+  int precompiled;
+};
+
+struct FileName {
+  char *path;
+  struct File *file; // NULL if nothing is there
+  struct FileName *next;
+};
+
+#define FILE_BUCKETS 1024
+
+struct FileName *file_names[FILE_BUCKETS];
+
+// real paths, so that different names for one file share it
+struct FileName *real_paths[FILE_BUCKETS];
+
+unsigned int hash_path(const char *path) {
+  unsigned int hash = 2166136261u;
+
+  for (; *path; path++) {
+    hash = (hash ^ (unsigned char)*path) * 16777619u;
+  }
+
+  return hash % FILE_BUCKETS;
+}
+
+struct FileName *find_name(struct FileName **table, char *path) {
+  for (struct FileName *name = table[hash_path(path)]; name;
+       name = name->next) {
+    if (!strcmp(name->path, path)) {
+      return name;
+    }
+  }
+
+  return NULL;
+}
+
+struct FileName *add_name(struct FileName **table, char *path,
+                          struct File *file) {
+  struct FileName *name = malloc(sizeof(*name));
+  unsigned int hash = hash_path(path);
+
+  name->path = strdup(path);
+  name->file = file;
+  name->next = table[hash];
+  table[hash] = name;
+
+  return name;
+}
+
+// the cached file at path, mapping it the first time it is seen
+struct File *open_file(char *path) {
+  struct FileName *name = find_name(file_names, path);
+
+  if (name) {
+    return name->file;
+  }
+
+  char *real = realpath(path, NULL);
+  struct File *file = NULL;
+
+  if (real) {
+    struct FileName *real_name = find_name(real_paths, real);
+
+    if (real_name) {
+      file = real_name->file;
+    } else {
+      struct Source *src = map_source(strdup(path));
+
+      if (src) {
+        file = malloc(sizeof(*file));
+        file->path = strdup(real);
+        file->source = src;
+        file->guard = 0;
+        file->precompiled = 0;
+        add_name(real_paths, real, file);
+      }
+    }
+
+    free(real);
+  }
+
+  add_name(file_names, path, file);
+  return file;
+}
+
+void visit_files(void (*visit)(char *path, struct Source *source)) {
+  for (int i = 0; i < FILE_BUCKETS; i++) {
+    for (struct FileName *name = real_paths[i]; name; name = name->next) {
+      visit(name->file->path, name->file->source);
+    }
+  }
+}
+
+struct Source *precompiled_file(char *path) {
+  struct File *file = open_file(path);
+
+  if (file == NULL) {
+    return NULL;
+  }
+
+  file->precompiled = 1;
+  return file->source;
+}
+
+char **include_paths = NULL;
+int n_include_paths = 0;
+
+void add_include_path(char *path) {
+  include_paths =
+      realloc(include_paths, (n_include_paths + 1) * sizeof(*include_paths));
+  include_paths[n_include_paths++] = path;
+}
+
+// "name" is looked for next to the current file then in the include paths
+// <name> is only looked for in the include paths
+struct File *find_include(char *name, int angled) {
+  char path[PATH_MAX];
+
+  if (name[0] == '/') {
+    return open_file(name);
+  }
+
+  if (!angled) {
+    char *from = source->name;
+    char *slash = strrchr(from, '/');
+    int dir_len = slash ? slash - from + 1 : 0;
+
+    snprintf(path, sizeof(path), "%.*s%s", dir_len, from, name);
+    struct File *file = open_file(path);
+
+    if (file) {
+      return file;
+    }
+  }
+
+  for (int i = 0; i < n_include_paths; i++) {
+    snprintf(path, sizeof(path), "%s/%s", include_paths[i], name);
+    struct File *file = open_file(path);
+
+    if (file) {
+      return file;
+    }
+  }
+
+  return NULL;
+}
+
+// conditional directives being processed
+struct Cond {
+  int was_active; // whether the region around this one is active
+  int taken;      // a branch has been active already
+  int seen_else;
+  unsigned int loc;
+};
+
+#define MAX_CONDS 256
+
+struct Cond conds[MAX_CONDS];
+int n_conds = 0;
+
+// whether tokens are being kept
+int active = 1;
+
+// include guard detection
+// a file is guarded if, ignoring whitespace and comments, it is exactly
+// #ifndef X ... #endif, then including it again once X is defined does
+// nothing so it doesn't need to be read
+enum GuardState {
+  GUARD_START,  // nothing seen yet
+  GUARD_OPEN,   // inside the #ifndef
+  GUARD_CLOSED, // after the #endif
+  GUARD_NONE,   // something outside the #ifndef, not guarded
+};
+
+struct Include {
+  struct File *file; // NULL for the main file
+  enum GuardState guard_state;
+  unsigned int guard;
+  int n_conds; // conds open when the file was entered
+};
+
+struct Include includes[MAX_INPUTS];
+
+struct Include *cur_include() { return &includes[input_depth() - 1]; }
+
+// anything outside the guard's #ifndef and #endif
+void not_guarded() {
+  if (cur_include()->guard_state != GUARD_OPEN) {
+    cur_include()->guard_state = GUARD_NONE;
+  }
+}
+
+// skip to the end of the directive
+void skip_directive() {
+  while (lex_directive_token().kind != EOD) {
+  }
+}
+
+void expect_eod() {
+  struct Token token = lex_directive_token();
+
+  if (token.kind != EOD) {
+    printf("Syntax error: extra tokens at end of directive\n");
+    pp_error(token.loc);
+  }
+}
+
+unsigned int directive_ident(char *directive) {
+  struct Token token = lex_directive_token();
+
+  if (token.kind != IDENT) {
+    printf("Syntax error: expected identifier after #%s\n", directive);
+    pp_error(token.loc);
+  }
+
+  return token.ident;
+}
+
+void push_cond(int cond, unsigned int loc) {
+  if (n_conds == MAX_CONDS) {
+    printf("Error: conditionals nested too deeply\n");
+    pp_error(loc);
+  }
+
+  conds[n_conds++] = (struct Cond){active, active && cond, 0, loc};
+  active = active && cond;
+}
+
+void include_directive(unsigned int loc) {
+  struct Token token = lex_directive_token();
+  char name[PATH_MAX];
+  int angled = token.kind == LT;
+
+  if (token.kind == STRING && token.str_literal.len < sizeof(name)) {
+    memcpy(name, loc_ptr(token.str_literal.loc), token.str_literal.len);
+    name[token.str_literal.len] = '\0';
+    expect_eod();
+  } else if (angled) {
+    // <name> isn't made of tokens, take it straight from the source
+    struct Source *src = loc_source(token.loc);
+    const char *end = src->buf + src->len;
+    const char *start = loc_ptr(token.loc) + 1;
+    const char *p = start;
+
+    while (p < end && *p != '>' && *p != '\n' &&
+           p - start < (long)sizeof(name) - 1) {
+      p++;
+    }
+
+    if (p == end || *p != '>') {
+      printf("Syntax error: unterminated header name after #include <\n");
+      pp_error(token.loc);
+    }
+
+    memcpy(name, start, p - start);
+    name[p - start] = '\0';
+    skip_directive();
+  } else {
+    printf("Syntax error: expected file name after #include\n");
+    pp_error(token.loc);
+  }
+
+  struct File *file = find_include(name, angled);
+
+  if (file == NULL) {
+    printf("Error: couldn't find include file %s\n", name);
+    pp_error(loc);
+  }
+
+  if (file->precompiled || (file->guard && lookup_macro(file->guard))) {
+    return;
+  }
+
+  push_input(file->source);
+  *cur_include() = (struct Include){file, GUARD_START, 0, n_conds};
+}
+
+void define_directive(unsigned int loc) {
+  unsigned int name = directive_ident("define");
+  struct Macro *macro = calloc(1, sizeof(*macro));
+  macro->name = name;
+  macro->loc = loc;
+
+  struct Token token = lex_directive_token();
+  int cap = 0;
+
+  // only a ( straight after the name makes a function-like macro
+  if (token.kind == L_PAREN && !(token.flags & TOK_SPACE)) {
+    macro->function_like = 1;
+    token = lex_directive_token();
+
+    while (token.kind != R_PAREN) {
+      if (token.kind != IDENT) {
+        printf("Syntax error: expected parameter name in #define\n");
+        pp_error(token.loc);
+      }
+
+      for (int i = 0; i < macro->n_params; i++) {
+        if (macro->params[i] == token.ident) {
+          printf("Error: duplicate macro parameter '%s'\n",
+                 intern_str(token.ident));
+          pp_error(token.loc);
+        }
+      }
+
+      if (macro->n_params == cap) {
+        cap = cap ? cap * 2 : 4;
+        macro->params = realloc(macro->params, cap * sizeof(unsigned int));
+      }
+
+      macro->params[macro->n_params++] = token.ident;
+      token = lex_directive_token();
+
+      if (token.kind == COMMA) {
+        token = lex_directive_token();
+      } else if (token.kind != R_PAREN) {
+        printf("Syntax error: expected ',' or ')' in macro parameters\n");
+        pp_error(token.loc);
+      }
+    }
+
+    token = lex_directive_token();
+  }
+
+  cap = 0;
+
+  while (token.kind != EOD) {
+    if (token.kind == IDENT) {
+      for (int i = 0; i < macro->n_params; i++) {
+        if (macro->params[i] == token.ident) {
+          token.kind = PARAM;
+          token.int_literal = i;
+        }
+      }
+    }
+
+    if (macro->body_len == cap) {
+      cap = cap ? cap * 2 : 8;
+      macro->body = realloc(macro->body, cap * sizeof(struct Token));
+    }
+
+    token.flags &= ~TOK_BOL;
+    macro->body[macro->body_len++] = token;
+    token = lex_directive_token();
+  }
+
+  for (int i = 0; i < macro->body_len; i++) {
+    struct Token *body = macro->body;
+
+    if (body[i].kind == HASH_HASH &&
+        (i == 0 || i == macro->body_len - 1)) {
+      printf("Syntax error: '##' cannot be at either end of a macro\n");
+      pp_error(body[i].loc);
+    }
+
+    if (body[i].kind == HASH && macro->function_like &&
+        (i == macro->body_len - 1 || body[i + 1].kind != PARAM)) {
+      printf("Syntax error: '#' is not followed by a macro parameter\n");
+      pp_error(body[i].loc);
+    }
+  }
+
+  define_macro(macro);
+}
+
+// the conditional an #elif or #else belongs to
+struct Cond *else_cond(struct Token token, char *directive) {
+  if (n_conds == cur_include()->n_conds) {
+    printf("Syntax error: #%s without #if\n", directive);
+    pp_error(token.loc);
+  }
+
+  struct Cond *cond = &conds[n_conds - 1];
+
+  if (cond->seen_else) {
+    printf("Syntax error: #%s after #else\n", directive);
+    pp_error(token.loc);
+  }
+
+  return cond;
+}
+
+int eval_if();
+
+void directive(struct Token hash) {
+  struct Token token = lex_directive_token();
+  enum Directive kind = N_DIRECTIVES;
+
+  if (token.kind == EOD) {
+    // null directive
+    return;
+  }
+
+  if (token.kind == IDENT) {
+    for (int i = 0; i < N_DIRECTIVES; i++) {
+      if (token.ident == directive_ids[i]) {
+        kind = i;
+      }
+    }
+  }
+
+  // the guard's own #ifndef and #endif are checked for below
+  if (kind != D_IFNDEF && kind != D_ENDIF) {
+    not_guarded();
+  }
+
+  // an #else for the guard means the file isn't all inside it
+  if ((token.kind == ELSE || kind == D_ELIF) &&
+      n_conds == cur_include()->n_conds + 1) {
+    cur_include()->guard_state = GUARD_NONE;
+  }
+
+  if (token.kind == IF) {
+    // nothing is evaluated in an inactive region
+    push_cond(active && eval_if(), hash.loc);
+    return;
+  }
+
+  if (kind == D_ELIF) {
+    struct Cond *cond = else_cond(token, "elif");
+    active = cond->was_active && !cond->taken && eval_if();
+    cond->taken |= active;
+    return;
+  }
+
+  if (token.kind == ELSE) {
+    struct Cond *cond = else_cond(token, "else");
+    cond->seen_else = 1;
+    active = cond->was_active && !cond->taken;
+    cond->taken = 1;
+
+    expect_eod();
+    return;
+  }
+
+  switch (kind) {
+  case D_IFDEF:
+  case D_IFNDEF:;
+    if (!active) {
+      push_cond(0, hash.loc);
+      return;
+    }
+
+    unsigned int name = directive_ident(directive_names[kind]);
+    int defined = lookup_macro(name) != NULL;
+    expect_eod();
+
+    if (kind == D_IFNDEF && cur_include()->guard_state == GUARD_START) {
+      cur_include()->guard_state = GUARD_OPEN;
+      cur_include()->guard = name;
+    } else {
+      not_guarded();
+    }
+
+    push_cond(kind == D_IFDEF ? defined : !defined, hash.loc);
+    return;
+
+  case D_ENDIF:
+    if (n_conds == cur_include()->n_conds) {
+      printf("Syntax error: #endif without #if\n");
+      pp_error(token.loc);
+    }
+
+    active = conds[--n_conds].was_active;
+
+    if (cur_include()->guard_state == GUARD_OPEN &&
+        n_conds == cur_include()->n_conds) {
+      cur_include()->guard_state = GUARD_CLOSED;
+    } else {
+      not_guarded();
+    }
+
+    expect_eod();
+    return;
+
+  default:
+    break;
+  }
+
+  // the rest only matter in active regions
+  // the line is skipped along with the region
+  if (!active) {
+    return;
+  }
+
+  switch (kind) {
+  case D_INCLUDE:
+    include_directive(hash.loc);
+    break;
+
+  case D_DEFINE:
+    define_directive(token.loc);
+    break;
+
+  case D_UNDEF:;
+    unsigned int name = directive_ident("undef");
+
+    if (lookup_macro(name)) {
+      free_macro(macros[name]);
+      macros[name] = NULL;
+    }
+
+    expect_eod();
+    break;
+
+  case D_ERROR:
+    printf("Error: #error\n");
+    pp_error(hash.loc);
+    break;
+
+  case D_PRAGMA:
+  case D_LINE:
+    skip_directive();
+    break;
+
+  default:
+    printf("Syntax error: unknown directive\n");
+    pp_error(token.loc);
+  }
+}
+
+// the end of an input, returns 1 if it was an included file
+int end_input() {
+  struct Include *include = cur_include();
+
+  if (n_conds > include->n_conds) {
+    printf("Syntax error: unterminated conditional\n");
+    pp_error(conds[n_conds - 1].loc);
+  }
+
+  if (include->file == NULL) {
+    return 0;
+  }
+
+  if (include->guard_state == GUARD_CLOSED) {
+    include->file->guard = include->guard;
+  }
+
+  pop_input();
+  return 1;
+}
+
+// hide sets
+// the names of the macros a token came out of, which it can't expand again
+// sets are sorted lists, hash consed so each set has one id and 0 is empty
+struct HideSet {
+  unsigned int name;
+  unsigned int rest;
+};
+
+struct HideSet *hide_sets = NULL;
+unsigned int n_hide_sets = 1;
+unsigned int hide_sets_cap = 0;
+
+// open addressed table from (name, rest) to the set's id
+unsigned int *hide_set_table = NULL;
+unsigned int hide_set_table_cap = 0;
+
+unsigned int hash_hide_set(unsigned int name, unsigned int rest) {
+  return (name * 0x9E3779B1u) ^ (rest * 0x85EBCA77u);
+}
+
+unsigned int hs_cons(unsigned int name, unsigned int rest) {
+  if (n_hide_sets * 2 >= hide_set_table_cap) {
+    unsigned int cap = hide_set_table_cap ? hide_set_table_cap * 2 : 1024;
+    free(hide_set_table);
+    hide_set_table = calloc(cap, sizeof(unsigned int));
+    hide_set_table_cap = cap;
+
+    for (unsigned int id = 1; id < n_hide_sets; id++) {
+      unsigned int i = hash_hide_set(hide_sets[id].name, hide_sets[id].rest);
+
+      while (hide_set_table[i & (cap - 1)]) {
+        i++;
+      }
+
+      hide_set_table[i & (cap - 1)] = id;
+    }
+  }
+
+  unsigned int mask = hide_set_table_cap - 1;
+  unsigned int i = hash_hide_set(name, rest);
+
+  for (; hide_set_table[i & mask]; i++) {
+    struct HideSet *set = &hide_sets[hide_set_table[i & mask]];
+
+    if (set->name == name && set->rest == rest) {
+      return hide_set_table[i & mask];
+    }
+  }
+
+  if (n_hide_sets >= hide_sets_cap) {
+    hide_sets_cap = hide_sets_cap ? hide_sets_cap * 2 : 1024;
+    hide_sets = realloc(hide_sets, hide_sets_cap * sizeof(struct HideSet));
+  }
+
+  hide_sets[n_hide_sets] = (struct HideSet){name, rest};
+  hide_set_table[i & mask] = n_hide_sets;
+  return n_hide_sets++;
+}
+
+int hs_contains(unsigned int set, unsigned int name) {
+  for (; set && hide_sets[set].name <= name; set = hide_sets[set].rest) {
+    if (hide_sets[set].name == name) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+unsigned int hs_add(unsigned int set, unsigned int name) {
+  if (set == 0 || name < hide_sets[set].name) {
+    return hs_cons(name, set);
+  }
+
+  if (name == hide_sets[set].name) {
+    return set;
+  }
+
+  unsigned int rest = hs_add(hide_sets[set].rest, name);
+  return rest == hide_sets[set].rest ? set : hs_cons(hide_sets[set].name, rest);
+}
+
+// every token of an expansion gets the same union, so the last few are cached
+#define UNION_CACHE_SIZE 1024
+
+struct {
+  unsigned int a;
+  unsigned int b;
+  unsigned int result;
+} union_cache[UNION_CACHE_SIZE];
+
+unsigned int hs_union(unsigned int a, unsigned int b) {
+  if (a == 0 || a == b) {
+    return b;
+  }
+
+  if (b == 0) {
+    return a;
+  }
+
+  unsigned int slot = hash_hide_set(a, b) % UNION_CACHE_SIZE;
+
+  if (union_cache[slot].a == a && union_cache[slot].b == b) {
+    return union_cache[slot].result;
+  }
+
+  unsigned int result = a;
+
+  for (unsigned int set = b; set; set = hide_sets[set].rest) {
+    result = hs_add(result, hide_sets[set].name);
+  }
+
+  union_cache[slot].a = a;
+  union_cache[slot].b = b;
+  union_cache[slot].result = result;
+  return result;
+}
+
+unsigned int hs_intersect(unsigned int a, unsigned int b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+
+  if (hide_sets[a].name == hide_sets[b].name) {
+    return hs_cons(hide_sets[a].name,
+                   hs_intersect(hide_sets[a].rest, hide_sets[b].rest));
+  }
+
+  if (hide_sets[a].name < hide_sets[b].name) {
+    return hs_intersect(hide_sets[a].rest, b);
+  }
+
+  return hs_intersect(a, hide_sets[b].rest);
+}
+
+// literals use the union for their value
+int has_hide_set(enum TokenKind kind) {
+  return kind != INTEGER && kind != FLOAT && kind != STRING && kind != CHAR;
+}
+
+// token lists made while expanding live in this arena
+// it is reset whenever nothing is left to rescan
+struct Arena expand_arena;
+
+struct TokenVec {
+  struct Token *tokens;
+  int len;
+  int cap; // 0 if tokens points into another list
+};
+
+void vec_reserve(struct TokenVec *vec, int len) {
+  if (len <= vec->cap) {
+    return;
+  }
+
+  int cap = vec->cap ? vec->cap * 2 : 16;
+
+  while (cap < len) {
+    cap *= 2;
+  }
+
+  struct Token *tokens =
+      arena_alloc(&expand_arena, cap * sizeof(struct Token));
+
+  if (vec->len) {
+    memcpy(tokens, vec->tokens, vec->len * sizeof(struct Token));
+  }
+
+  vec->tokens = tokens;
+  vec->cap = cap;
+}
+
+void vec_push(struct TokenVec *vec, struct Token token) {
+  vec_reserve(vec, vec->len + 1);
+  vec->tokens[vec->len++] = token;
+}
+
+void vec_append(struct TokenVec *vec, struct Token *tokens, int len) {
+  if (len) {
+    vec_reserve(vec, vec->len + len);
+    memcpy(vec->tokens + vec->len, tokens, len * sizeof(struct Token));
+    vec->len += len;
+  }
+}
+
+// expansions waiting to be rescanned, innermost last
+// a barrier frame ends the input instead of falling through to the frame
+// below it, so an argument is expanded on its own
+struct Frame {
+  struct Token *tokens;
+  int len;
+  int pos;
+  int barrier;
+};
+
+struct Frame *frames = NULL;
+int n_frames = 0;
+int frames_cap = 0;
+
+void push_frame(struct Token *tokens, int len, int barrier) {
+  if (n_frames == frames_cap) {
+    frames_cap = frames_cap ? frames_cap * 2 : 16;
+    frames = realloc(frames, frames_cap * sizeof(struct Frame));
+  }
+
+  frames[n_frames++] = (struct Frame){tokens, len, 0, barrier};
+}
+
+// where next_token got its last token from
+enum { FROM_LEXER, FROM_FRAME, FROM_BARRIER } last_from;
+
+// a token read from the lexer and put back
+struct Token peeked;
+int has_peeked = 0;
+
+struct Token next_token() {
+  while (n_frames) {
+    struct Frame *frame = &frames[n_frames - 1];
+
+    if (frame->pos < frame->len) {
+      last_from = FROM_FRAME;
+      return frame->tokens[frame->pos++];
+    }
+
+    if (frame->barrier) {
+      last_from = FROM_BARRIER;
+      return (struct Token){.kind = EOD, .loc = 0};
+    }
+
+    n_frames--;
+  }
+
+  last_from = FROM_LEXER;
+
+  if (has_peeked) {
+    has_peeked = 0;
+    return peeked;
+  }
+
+  return lex_token();
+}
+
+// put back the token just read by next_token
+void unread_token(struct Token token) {
+  if (last_from == FROM_FRAME) {
+    frames[n_frames - 1].pos--;
+  } else if (last_from == FROM_LEXER) {
+    peeked = token;
+    has_peeked = 1;
+  }
+}
+
+// push the token just read by next_token
+// a run of tokens read straight from one frame is used in place, and only
+// copied if the run is broken
+void vec_push_read(struct TokenVec *vec, struct Token token) {
+  if (last_from == FROM_FRAME && vec->cap == 0) {
+    struct Frame *frame = &frames[n_frames - 1];
+    struct Token *at = &frame->tokens[frame->pos - 1];
+
+    if (vec->len == 0) {
+      vec->tokens = at;
+    }
+
+    if (vec->tokens + vec->len == at) {
+      vec->len++;
+      return;
+    }
+  }
+
+  vec_push(vec, token);
+}
+
+// the arguments of one use of a function-like macro
+struct Invocation {
+  struct TokenVec *args;
+
+  // fully expanded arguments, made the first time they are needed
+  struct TokenVec **expanded;
+};
+
+int expand_macro(struct Token name);
+
+// read the arguments up to the closing ), which is returned
+struct Token collect_args(struct Macro *macro, struct Invocation *inv,
+                          struct Token name) {
+  int n_params = macro->n_params;
+  int size = n_params + 1;
+
+  inv->args = arena_alloc(&expand_arena, size * sizeof(struct TokenVec));
+  inv->expanded = arena_alloc(&expand_arena, size * sizeof(void *));
+  memset(inv->expanded, 0, size * sizeof(void *));
+
+  struct TokenVec arg = {NULL, 0, 0};
+  int n_args = 0;
+  int depth = 0;
+
+  while (1) {
+    struct Token token = next_token();
+
+    if (last_from == FROM_BARRIER || token.kind == END ||
+        (last_from == FROM_LEXER && token.kind == HASH &&
+         token.flags & TOK_BOL)) {
+      printf("Syntax error: unterminated call to macro '%s'\n",
+             intern_str(name.ident));
+      pp_error(name.loc);
+    }
+
+    if (depth == 0 && (token.kind == COMMA || token.kind == R_PAREN)) {
+      // f() has no arguments if f has no parameters
+      if (token.kind == COMMA || n_args || arg.len || n_params) {
+        if (n_args < n_params) {
+          inv->args[n_args] = arg;
+        }
+
+        n_args++;
+      }
+
+      arg = (struct TokenVec){NULL, 0, 0};
+
+      if (token.kind == R_PAREN) {
+        if (n_args != n_params) {
+          printf("Error: macro '%s' takes %d arguments but %d were given\n",
+                 intern_str(name.ident), n_params, n_args);
+          pp_error(name.loc);
+        }
+
+        return token;
+      }
+
+      continue;
+    }
+
+    if (token.kind == L_PAREN) {
+      depth++;
+    } else if (token.kind == R_PAREN) {
+      depth--;
+    }
+
+    vec_push_read(&arg, token);
+  }
+}
+
+// fully macro expand a list of tokens
+struct TokenVec expand_list(struct TokenVec *list) {
+  struct TokenVec result = {NULL, 0, 0};
+  push_frame(list->tokens, list->len, 1);
+
+  while (1) {
+    struct Token token = next_token();
+
+    if (last_from == FROM_BARRIER) {
+      break;
+    }
+
+    if (token.kind == IDENT && expand_macro(token)) {
+      continue;
+    }
+
+    vec_push_read(&result, token);
+  }
+
+  n_frames--;
+  return result;
+}
+
+struct TokenVec *expanded_arg(struct Invocation *inv, int i) {
+  if (inv->expanded[i] == NULL) {
+    struct TokenVec result = expand_list(&inv->args[i]);
+    inv->expanded[i] = arena_alloc(&expand_arena, sizeof(struct TokenVec));
+    *inv->expanded[i] = result;
+  }
+
+  return inv->expanded[i];
+}
+
+// text built up for # and ##
+char *paste_text = NULL;
+int paste_len = 0;
+int paste_cap = 0;
+
+void append_text(const char *str, int len) {
+  if (paste_len + len > paste_cap) {
+    paste_cap = paste_cap ? paste_cap * 2 : 256;
+
+    while (paste_len + len > paste_cap) {
+      paste_cap *= 2;
+    }
+
+    paste_text = realloc(paste_text, paste_cap);
+  }
+
+  memcpy(paste_text + paste_len, str, len);
+  paste_len += len;
+}
+
+// append a token as it is written
+// inside a string or character literal " and \ are escaped, for #
+void spell_token(struct Token token, int escape) {
+  if (token.kind == PLACEMARKER) {
+    return;
+  }
+
+  if (token.kind == IDENT) {
+    append_text(intern_str(token.ident), intern_len(token.ident));
+    return;
+  }
+
+  int len;
+  lex_at(token.loc, &len);
+  const char *p = loc_ptr(token.loc);
+
+  if (!escape || (token.kind != STRING && token.kind != CHAR)) {
+    append_text(p, len);
+    return;
+  }
+
+  for (int i = 0; i < len; i++) {
+    if (p[i] == '"' || p[i] == '\\') {
+      append_text("\\", 1);
+    }
+
+    append_text(p + i, 1);
+  }
+}
+
+// lex text as exactly one token
+struct Token relex_text(struct Token at) {
+  unsigned int loc = scratch_text(paste_text, paste_len);
+  int len;
+  struct Token token = lex_at(loc, &len);
+
+  if (len != paste_len) {
+    printf("Error: '%.*s' is not a valid token\n", paste_len, paste_text);
+    pp_error(at.loc);
+  }
+
+  token.flags = at.flags & ~TOK_BOL;
+  return token;
+}
+
+struct Token stringize(struct Token hash, struct TokenVec *arg) {
+  paste_len = 0;
+  append_text("\"", 1);
+
+  for (int i = 0; i < arg->len; i++) {
+    if (i && arg->tokens[i].flags & (TOK_SPACE | TOK_BOL)) {
+      append_text(" ", 1);
+    }
+
+    spell_token(arg->tokens[i], 1);
+  }
+
+  append_text("\"", 1);
+  return relex_text(hash);
+}
+
+void debug_tokens() {
+  for (int i = 0; tokens[i].kind != END; i++) {
+    if (i && tokens[i].flags & TOK_BOL) {
+      printf("\n");
+    } else if (i && tokens[i].flags & TOK_SPACE) {
+      printf(" ");
+    }
+
+    paste_len = 0;
+    spell_token(tokens[i], 0);
+    printf("%.*s", paste_len, paste_text);
+  }
+
+  printf("\n");
+}
+
+struct Token paste(struct Token lhs, struct Token rhs) {
+  if (lhs.kind == PLACEMARKER) {
+    return rhs;
+  }
+
+  if (rhs.kind == PLACEMARKER) {
+    return lhs;
+  }
+
+  paste_len = 0;
+  spell_token(lhs, 0);
+  spell_token(rhs, 0);
+  return relex_text(lhs);
+}
+
+// token takes the place of at, along with the space before it
+void take_space(struct Token *token, struct Token at) {
+  unsigned short space = TOK_SPACE | TOK_BOL;
+  token->flags = (token->flags & ~space) | (at.flags & space);
+}
+
+// the body of a macro with its arguments substituted in
+// every token is added to the hide set hs
+struct TokenVec subst(struct Macro *macro, struct Invocation *inv,
+                      unsigned int hs) {
+  struct TokenVec result = {NULL, 0, 0};
+  struct Token *body = macro->body;
+  int len = macro->body_len;
+
+  vec_reserve(&result, len);
+
+  for (int i = 0; i < len; i++) {
+    struct Token token = body[i];
+
+    if (token.kind == HASH && macro->function_like) {
+      i++;
+      vec_push(&result, stringize(token, &inv->args[body[i].int_literal]));
+      continue;
+    }
+
+    if (token.kind == HASH_HASH) {
+      struct Token *lhs = &result.tokens[result.len - 1];
+      struct Token rhs = body[++i];
+
+      if (rhs.kind != PARAM) {
+        *lhs = paste(*lhs, rhs);
+        continue;
+      }
+
+      // only the first token of the argument is pasted
+      struct TokenVec *arg = &inv->args[rhs.int_literal];
+
+      if (arg->len) {
+        *lhs = paste(*lhs, arg->tokens[0]);
+        vec_append(&result, arg->tokens + 1, arg->len - 1);
+      }
+
+      continue;
+    }
+
+    if (token.kind == PARAM) {
+      // arguments next to ## aren't expanded
+      if (i + 1 < len && body[i + 1].kind == HASH_HASH) {
+        struct TokenVec *arg = &inv->args[token.int_literal];
+
+        if (arg->len == 0) {
+          token.kind = PLACEMARKER;
+          vec_push(&result, token);
+        } else {
+          vec_append(&result, arg->tokens, arg->len);
+          take_space(&result.tokens[result.len - arg->len], token);
+        }
+      } else {
+        struct TokenVec *arg = expanded_arg(inv, token.int_literal);
+        vec_append(&result, arg->tokens, arg->len);
+
+        if (arg->len) {
+          take_space(&result.tokens[result.len - arg->len], token);
+        }
+      }
+
+      continue;
+    }
+
+    vec_push(&result, token);
+  }
+
+  int n = 0;
+
+  for (int i = 0; i < result.len; i++) {
+    struct Token token = result.tokens[i];
+
+    if (token.kind == PLACEMARKER) {
+      continue;
+    }
+
+    if (has_hide_set(token.kind)) {
+      token.hide_set = hs_union(token.hide_set, hs);
+    }
+
+    result.tokens[n++] = token;
+  }
+
+  result.len = n;
+  return result;
+}
+
+// push the expansion of name if it's a macro that can be expanded here
+int expand_macro(struct Token name) {
+  struct Macro *macro = lookup_macro(name.ident);
+
+  if (macro == NULL || hs_contains(name.hide_set, name.ident)) {
+    return 0;
+  }
+
+  struct Invocation inv = {NULL, NULL};
+  unsigned int hs = name.hide_set;
+
+  if (macro->function_like) {
+    struct Token paren = next_token();
+
+    // a function-like macro's name on its own is left alone
+    if (paren.kind != L_PAREN || last_from == FROM_BARRIER) {
+      unread_token(paren);
+      return 0;
+    }
+
+    struct Token close = collect_args(macro, &inv, name);
+    hs = hs_intersect(hs, close.hide_set);
+  }
+
+  struct TokenVec result = subst(macro, &inv, hs_add(hs, name.ident));
+
+  if (result.len) {
+    take_space(&result.tokens[0], name);
+    push_frame(result.tokens, result.len, 0);
+  }
+
+  return 1;
+}
+
+// #if expressions
+// defined is handled before the line is macro expanded, then any
+// identifiers left are 0 and the rest is evaluated like a C constant
+// expression in long or unsigned long
+
+struct Value {
+  long n;
+  int is_unsigned;
+};
+
+struct Token *if_tokens;
+int n_if_tokens;
+int if_pos;
+
+// whether the part being read is evaluated, it isn't on the skipped side
+// of &&, || and ?: so 1 / 0 there isn't an error
+int evaluating;
+
+struct Token defined_operator(struct Token defined) {
+  struct Token token = lex_directive_token();
+  int paren = token.kind == L_PAREN;
+
+  if (paren) {
+    token = lex_directive_token();
+  }
+
+  if (token.kind != IDENT) {
+    printf("Syntax error: expected macro name after defined\n");
+    pp_error(token.loc);
+  }
+
+  int is_defined = lookup_macro(token.ident) != NULL;
+
+  if (paren && lex_directive_token().kind != R_PAREN) {
+    printf("Syntax error: expected ')' after defined(%s\n",
+           intern_str(token.ident));
+    pp_error(token.loc);
+  }
+
+  return (struct Token){.kind = INTEGER, .loc = defined.loc,
+                        .int_literal = is_defined};
+}
+
+struct Token if_token() {
+  if (if_pos < n_if_tokens) {
+    return if_tokens[if_pos];
+  }
+
+  return (struct Token){.kind = EOD, .loc = if_tokens[n_if_tokens - 1].loc};
+}
+
+void expect_if_token(enum TokenKind kind, char *what) {
+  if (if_token().kind != kind) {
+    printf("Syntax error: expected %s in #if expression\n", what);
+    pp_error(if_token().loc);
+  }
+
+  if_pos++;
+}
+
+struct Value eval_ternary();
+
+struct Value eval_unary() {
+  struct Token token = if_token();
+  if_pos++;
+
+  switch (token.kind) {
+  case INTEGER:
+    return (struct Value){token.int_literal, token.flags & LIT_UNSIGNED};
+
+  case CHAR:
+    return (struct Value){token.char_literal, 0};
+
+  case PLUS:
+    return eval_unary();
+
+  case MINUS:;
+    struct Value value = eval_unary();
+    value.n = -(unsigned long)value.n;
+    return value;
+
+  case TILDE:
+    value = eval_unary();
+    value.n = ~value.n;
+    return value;
+
+  case NOT:
+    value = eval_unary();
+    return (struct Value){!value.n, 0};
+
+  case L_PAREN:
+    value = eval_ternary();
+    expect_if_token(R_PAREN, "')'");
+    return value;
+
+  default:
+    // identifiers that aren't macros, keywords included, are 0
+    if (token.kind == IDENT ||
+        (token.kind >= IF && token.kind <= DOUBLE_TYPE)) {
+      return (struct Value){0, 0};
+    }
+
+    printf("Syntax error: expected a value in #if expression\n");
+    pp_error(token.loc);
+    return (struct Value){0, 0};
+  }
+}
+
+int binary_precedence(enum TokenKind kind) {
+  switch (kind) {
+  case STAR:
+  case SLASH:
+  case MOD:
+    return 10;
+  case PLUS:
+  case MINUS:
+    return 9;
+  case SHL:
+  case SHR:
+    return 8;
+  case LT:
+  case GT:
+  case LTE:
+  case GTE:
+    return 7;
+  case EQ:
+  case NE:
+    return 6;
+  case AMP:
+    return 5;
+  case CARET:
+    return 4;
+  case PIPE:
+    return 3;
+  case AND:
+    return 2;
+  case OR:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+struct Value eval_binary_op(struct Token op, struct Value lhs,
+                            struct Value rhs) {
+  // the usual arithmetic conversions, the result is unsigned if either is
+  int is_unsigned = lhs.is_unsigned || rhs.is_unsigned;
+  unsigned long a = lhs.n, b = rhs.n;
+  long n = 0;
+
+  if ((op.kind == SLASH || op.kind == MOD) && b == 0) {
+    if (evaluating) {
+      printf("Error: division by zero in #if expression\n");
+      pp_error(op.loc);
+    }
+
+    return (struct Value){0, is_unsigned};
+  }
+
+  switch (op.kind) {
+  case STAR:
+    n = a * b;
+    break;
+  case SLASH:
+    n = is_unsigned ? (long)(a / b) : lhs.n / rhs.n;
+    break;
+  case MOD:
+    n = is_unsigned ? (long)(a % b) : lhs.n % rhs.n;
+    break;
+  case PLUS:
+    n = a + b;
+    break;
+  case MINUS:
+    n = a - b;
+    break;
+  case SHL:
+    n = b < 64 ? a << b : 0;
+    return (struct Value){n, lhs.is_unsigned};
+  case SHR:
+    n = b < 64 ? (lhs.is_unsigned ? (long)(a >> b) : lhs.n >> b) : 0;
+    return (struct Value){n, lhs.is_unsigned};
+  case LT:
+    return (struct Value){is_unsigned ? a < b : lhs.n < rhs.n, 0};
+  case GT:
+    return (struct Value){is_unsigned ? a > b : lhs.n > rhs.n, 0};
+  case LTE:
+    return (struct Value){is_unsigned ? a <= b : lhs.n <= rhs.n, 0};
+  case GTE:
+    return (struct Value){is_unsigned ? a >= b : lhs.n >= rhs.n, 0};
+  case EQ:
+    return (struct Value){a == b, 0};
+  case NE:
+    return (struct Value){a != b, 0};
+  case AMP:
+    n = a & b;
+    break;
+  case CARET:
+    n = a ^ b;
+    break;
+  case PIPE:
+    n = a | b;
+    break;
+  case AND:
+    return (struct Value){a && b, 0};
+  case OR:
+    return (struct Value){a || b, 0};
+  default:
+    break;
+  }
+
+  return (struct Value){n, is_unsigned};
+}
+
+// precedence climbing over the binary operators
+struct Value eval_binary(int min_precedence) {
+  struct Value lhs = eval_unary();
+  int precedence;
+
+  while ((precedence = binary_precedence(if_token().kind)) >= min_precedence) {
+    struct Token op = if_token();
+    if_pos++;
+
+    int was_evaluating = evaluating;
+
+    if ((op.kind == AND && !lhs.n) || (op.kind == OR && lhs.n)) {
+      evaluating = 0;
+    }
+
+    struct Value rhs = eval_binary(precedence + 1);
+    evaluating = was_evaluating;
+    lhs = eval_binary_op(op, lhs, rhs);
+  }
+
+  return lhs;
+}
+
+struct Value eval_ternary() {
+  struct Value cond = eval_binary(1);
+
+  if (if_token().kind != QUESTION) {
+    return cond;
+  }
+
+  if_pos++;
+  int was_evaluating = evaluating;
+
+  evaluating = was_evaluating && cond.n;
+  struct Value lhs = eval_ternary();
+  expect_if_token(COLON, "':'");
+
+  evaluating = was_evaluating && !cond.n;
+  struct Value rhs = eval_ternary();
+  evaluating = was_evaluating;
+
+  struct Value value = cond.n ? lhs : rhs;
+  value.is_unsigned = lhs.is_unsigned || rhs.is_unsigned;
+  return value;
+}
+
+// read and evaluate the rest of an #if or #elif line
+int eval_if() {
+  struct TokenVec line = {NULL, 0, 0};
+  struct Token token;
+
+  while ((token = lex_directive_token()).kind != EOD) {
+    if (token.kind == IDENT && token.ident == defined_id) {
+      token = defined_operator(token);
+    }
+
+    vec_push(&line, token);
+  }
+
+  if (line.len == 0) {
+    printf("Syntax error: #if with no expression\n");
+    pp_error(token.loc);
+  }
+
+  struct TokenVec expanded = expand_list(&line);
+
+  if (expanded.len == 0) {
+    printf("Syntax error: #if expression is empty after macro expansion\n");
+    pp_error(line.tokens[0].loc);
+  }
+
+  if_tokens = expanded.tokens;
+  n_if_tokens = expanded.len;
+  if_pos = 0;
+  evaluating = 1;
+
+  struct Value value = eval_ternary();
+
+  if (if_pos < n_if_tokens) {
+    printf("Syntax error: unexpected token in #if expression\n");
+    pp_error(if_token().loc);
+  }
+
+  return value.n != 0;
+}
+
+struct Token preprocess_token() {
+  while (1) {
+    if (n_frames == 0) {
+      arena_reset(&expand_arena);
+    }
+
+    // jump straight to the next directive
+    if (!active) {
+      skip_inactive();
+    }
+
+    struct Token token = next_token();
+
+    // directives and the ends of files only come straight from the lexer
+    if (last_from == FROM_LEXER) {
+      if (token.kind == HASH && token.flags & TOK_BOL) {
+        directive(token);
+        continue;
+      }
+
+      if (token.kind == END) {
+        if (end_input()) {
+          continue;
+        }
+
+        return token;
+      }
+
+      not_guarded();
+    }
+
+    if (token.kind == IDENT && expand_macro(token)) {
+      continue;
+    }
+
+    return token;
+  }
+}
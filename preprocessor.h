@@ -0,0 +1,48 @@
+#ifndef PREPROCESSOR_HEADER
+#define PREPROCESSOR_HEADER
+
+#include "lexer.h"
+#include "source.h"
+
+void setup_preprocessor();
+
+// directories searched by #include, in order
+void add_include_path(char *path);
+
+// next token after preprocessing
+struct Token preprocess_token();
+
+// print the preprocessed tokens as text, a line for each line they started on
+void debug_tokens();
+
+struct Macro {
+  unsigned int name;
+  unsigned int loc;
+  int function_like;
+
+  unsigned int *params;
+  int n_params;
+
+  // uses of parameters are PARAM tokens holding the parameter's index
+  struct Token *body;
+  int body_len;
+};
+
+// NULL if name isn't defined
+struct Macro *lookup_macro(unsigned int name);
+
+// add a macro, replacing any old definition
+// the macro and its params and body are freed by #undef
+void define_macro(struct Macro *macro);
+
+// used for precompiled headers, see pch.c
+void visit_macros(void (*visit)(struct Macro *macro));
+
+// every file opened by #include, by real path
+void visit_files(void (*visit)(char *path, struct Source *source));
+
+// open a file and treat it as already included
+// returns NULL if it doesn't exist
+struct Source *precompiled_file(char *path);
+
+#endif
@@ -0,0 +1,315 @@
+#include "scan.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+// scalar versions
+// these also handle the tails that are too short for a vector
+
+int is_space_char(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+int is_ident_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+const char *space_scalar(const char *p, const char *end) {
+  while (p < end && is_space_char(*p))
+    p++;
+
+  return p;
+}
+
+const char *ident_scalar(const char *p, const char *end) {
+  while (p < end && is_ident_char(*p))
+    p++;
+
+  return p;
+}
+
+const char *line_end_scalar(const char *p, const char *end) {
+  while (p < end && *p != '\n')
+    p++;
+
+  return p;
+}
+
+const char *comment_end_scalar(const char *p, const char *end) {
+  while (p + 1 < end && !(p[0] == '*' && p[1] == '/'))
+    p++;
+
+  return p + 1 < end ? p : end;
+}
+
+const char *string_end_scalar(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+    p++;
+
+  return p;
+}
+
+int is_skipped_stop(char c) {
+  return c == '\n' || c == '/' || c == '"' || c == '\'' || c == '\\';
+}
+
+const char *skipped_scalar(const char *p, const char *end) {
+  while (p < end && !is_skipped_stop(*p))
+    p++;
+
+  return p;
+}
+
+#ifdef SCAN_X86
+
+// SSE2 versions, 16 chars at a time
+// each builds a mask of chars that end the run and returns the first one
+
+// whitespace is ' ' or '\t' to '\r'
+__m128i space_mask_sse2(__m128i x) {
+  __m128i ctrl = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+  __m128i is_ctrl = _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl);
+  return _mm_or_si128(is_ctrl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+// unsigned x - lo <= hi - lo
+__m128i in_range_sse2(__m128i x, char lo, char hi) {
+  __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+}
+
+__m128i ident_mask_sse2(__m128i x) {
+  // setting 0x20 maps upper case onto lower case
+  __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  __m128i alpha = in_range_sse2(lower, 'a', 'z');
+  __m128i digit = in_range_sse2(x, '0', '9');
+  __m128i under = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+const char *space_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    unsigned int stop = ~_mm_movemask_epi8(space_mask_sse2(x)) & 0xffff;
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return space_scalar(p, end);
+}
+
+const char *ident_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    unsigned int stop = ~_mm_movemask_epi8(ident_mask_sse2(x)) & 0xffff;
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return ident_scalar(p, end);
+}
+
+const char *line_end_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    unsigned int stop =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return line_end_scalar(p, end);
+}
+
+const char *comment_end_sse2(const char *p, const char *end) {
+  // compare against the block and the block shifted by one
+  for (; end - p >= 17; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i y = _mm_loadu_si128((const __m128i *)(p + 1));
+    unsigned int stop = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('*')),
+                      _mm_cmpeq_epi8(y, _mm_set1_epi8('/'))));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return comment_end_scalar(p, end);
+}
+
+const char *string_end_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+    __m128i slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+    __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+    unsigned int stop =
+        _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, slash), nl));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return string_end_scalar(p, end);
+}
+
+const char *skipped_sse2(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+    __m128i slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('/'));
+    __m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+    __m128i apos = _mm_cmpeq_epi8(x, _mm_set1_epi8('\''));
+    __m128i backslash = _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'));
+    unsigned int stop = _mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(_mm_or_si128(nl, slash), _mm_or_si128(quote, apos)),
+        backslash));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return skipped_scalar(p, end);
+}
+
+// AVX2 versions, 32 chars at a time
+// same as the SSE2 versions with wider vectors
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 __m256i space_mask_avx2(__m256i x) {
+  __m256i ctrl = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+  __m256i is_ctrl =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl);
+  return _mm256_or_si256(is_ctrl, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+AVX2 __m256i in_range_avx2(__m256i x, char lo, char hi) {
+  __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+}
+
+AVX2 __m256i ident_mask_avx2(__m256i x) {
+  __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+  __m256i alpha = in_range_avx2(lower, 'a', 'z');
+  __m256i digit = in_range_avx2(x, '0', '9');
+  __m256i under = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+AVX2 const char *space_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned int stop = ~_mm256_movemask_epi8(space_mask_avx2(x));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return space_sse2(p, end);
+}
+
+AVX2 const char *ident_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned int stop = ~_mm256_movemask_epi8(ident_mask_avx2(x));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return ident_sse2(p, end);
+}
+
+AVX2 const char *line_end_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned int stop =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return line_end_sse2(p, end);
+}
+
+AVX2 const char *comment_end_avx2(const char *p, const char *end) {
+  for (; end - p >= 33; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i y = _mm256_loadu_si256((const __m256i *)(p + 1));
+    unsigned int stop = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('*')),
+                         _mm256_cmpeq_epi8(y, _mm256_set1_epi8('/'))));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return comment_end_sse2(p, end);
+}
+
+AVX2 const char *string_end_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+    __m256i slash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+    unsigned int stop = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(quote, slash), nl));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return string_end_sse2(p, end);
+}
+
+AVX2 const char *skipped_avx2(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+    __m256i slash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/'));
+    __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+    __m256i apos = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\''));
+    __m256i backslash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+    unsigned int stop = _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(nl, slash),
+                        _mm256_or_si256(quote, apos)),
+        backslash));
+
+    if (stop)
+      return p + __builtin_ctz(stop);
+  }
+
+  return skipped_sse2(p, end);
+}
+
+#endif
+
+struct Scanner scan = {space_scalar,      ident_scalar,
+                       line_end_scalar,   comment_end_scalar,
+                       string_end_scalar, skipped_scalar,
+                       "scalar"};
+
+void setup_scanner() {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    scan = (struct Scanner){space_avx2,      ident_avx2,
+                            line_end_avx2,   comment_end_avx2,
+                            string_end_avx2, skipped_avx2,
+                            "avx2"};
+  } else if (__builtin_cpu_supports("sse2")) {
+    scan = (struct Scanner){space_sse2,      ident_sse2,
+                            line_end_sse2,   comment_end_sse2,
+                            string_end_sse2, skipped_sse2,
+                            "sse2"};
+  }
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef SCAN_HEADER
+#define SCAN_HEADER
+
+// fast scanning kernels used by the lexer
+// each takes a range of the source and returns a pointer to the first char
+// that ends the run, or end if the run goes to the end of the range
+//
+// SSE2 and AVX2 versions classify 16/32 chars at a time, the scalar version
+// is used when neither is available
+extern struct Scanner {
+  // first char that isn't whitespace
+  const char *(*space)(const char *p, const char *end);
+  // first char that can't be part of an identifier
+  const char *(*ident)(const char *p, const char *end);
+  // first newline
+  const char *(*line_end)(const char *p, const char *end);
+  // first "*/"
+  const char *(*comment_end)(const char *p, const char *end);
+  // first '"', '\\' or newline
+  const char *(*string_end)(const char *p, const char *end);
+  // first newline, '/', quote or '\\', the only chars that matter when
+  // skipping an inactive #if region
+  const char *(*skipped)(const char *p, const char *end);
+
+  char *name;
+} scan;
+
+// pick the best implementation for this cpu
+void setup_scanner();
+
+#endif
@@ -0,0 +1,237 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scan.h"
+#include "source.h"
+
+// every source that has been opened, in order of base
+struct Source **sources = NULL;
+int n_sources = 0;
+unsigned int next_base = 0;
+
+// give a new source its range of locations
+void add_source(struct Source *source) {
+  source->base = next_base;
+  source->lines = NULL;
+  source->n_lines = 0;
+
+  // leave a gap so a location just past the end still maps to this source
+  next_base += source->len + 1;
+
+  sources = realloc(sources, (n_sources + 1) * sizeof(*sources));
+  sources[n_sources++] = source;
+}
+
+// map a whole file into memory
+// returns NULL if the file can't be opened
+struct Source *map_source(char *path) {
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  struct Source *source = malloc(sizeof(*source));
+  source->name = path;
+  source->len = st.st_size;
+
+  if (source->len == 0) {
+    // can't map an empty file
+    source->buf = calloc(1, 1);
+    source->mapped = 0;
+    close(fd);
+    add_source(source);
+    return source;
+  }
+
+  void *buf = mmap(NULL, source->len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (buf == MAP_FAILED) {
+    // not mappable (e.g. a pipe), fall back to reading it
+    free(source);
+    FILE *stream = fopen(path, "r");
+
+    if (stream == NULL) {
+      return NULL;
+    }
+
+    source = read_source(stream, path);
+    fclose(stream);
+    return source;
+  }
+
+  // we read the file front to back
+  madvise(buf, source->len, MADV_SEQUENTIAL);
+
+  source->buf = buf;
+  source->mapped = 1;
+  add_source(source);
+
+  return source;
+}
+
+// read a whole stream into a buffer
+// used for stdin which can't be mapped
+struct Source *read_source(FILE *stream, char *name) {
+  long cap = 1 << 16;
+  long len = 0;
+  char *buf = malloc(cap);
+
+  while (1) {
+    len += fread(buf + len, 1, cap - len, stream);
+
+    if (len < cap) {
+      break;
+    }
+
+    cap *= 2;
+    buf = realloc(buf, cap);
+  }
+
+  struct Source *source = malloc(sizeof(*source));
+  source->name = name;
+  source->buf = buf;
+  source->len = len;
+  source->mapped = 0;
+  add_source(source);
+
+  return source;
+}
+
+#define SCRATCH_SIZE (1 << 16)
+
+struct Source *scratch = NULL;
+long scratch_used = 0;
+
+unsigned int scratch_text(const char *text, int len) {
+  // each piece of text is followed by a newline so the lexer stops there
+  if (scratch == NULL || scratch_used + len + 1 > scratch->len) {
+    long size = len + 1 > SCRATCH_SIZE ? len + 1 : SCRATCH_SIZE;
+
+    scratch = malloc(sizeof(*scratch));
+    scratch->name = "<scratch>";
+    scratch->buf = calloc(1, size);
+    scratch->len = size;
+    scratch->mapped = 0;
+    add_source(scratch);
+    scratch_used = 0;
+  }
+
+  char *p = (char *)scratch->buf + scratch_used;
+  memcpy(p, text, len);
+  p[len] = '\n';
+
+  scratch_used += len + 1;
+  return scratch->base + (p - scratch->buf);
+}
+
+void close_source(struct Source *source) {
+  if (source->mapped) {
+    munmap((void *)source->buf, source->len);
+  } else {
+    free((void *)source->buf);
+  }
+
+  // locations stay reserved, the source just can't be printed from any more
+  source->buf = NULL;
+  source->len = 0;
+  free(source->lines);
+  source->lines = NULL;
+}
+
+// find the source a location is in
+struct Source *loc_source(unsigned int loc) {
+  int lo = 0;
+  int hi = n_sources - 1;
+
+  if (loc == NO_LOC || n_sources == 0) {
+    return NULL;
+  }
+
+  // last source with base <= loc
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+
+    if (sources[mid]->base <= loc) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return sources[lo];
+}
+
+// the char at a location
+const char *loc_ptr(unsigned int loc) {
+  struct Source *source = loc_source(loc);
+  return source->buf + (loc - source->base);
+}
+
+// index the start of every line in a source
+void index_lines(struct Source *source) {
+  int cap = 1024;
+  const char *p = source->buf;
+  const char *end = source->buf + source->len;
+
+  source->lines = malloc(cap * sizeof(*source->lines));
+  source->lines[0] = 0;
+  source->n_lines = 1;
+
+  while ((p = scan.line_end(p, end)) < end) {
+    p++;
+
+    if (source->n_lines == cap) {
+      cap *= 2;
+      source->lines = realloc(source->lines, cap * sizeof(*source->lines));
+    }
+
+    source->lines[source->n_lines++] = p - source->buf;
+  }
+}
+
+// line and column of a location, both starting from 1
+void loc_line_col(unsigned int loc, int *line, int *col) {
+  struct Source *source = loc_source(loc);
+
+  if (source == NULL || source->buf == NULL) {
+    *line = 0;
+    *col = 0;
+    return;
+  }
+
+  if (source->lines == NULL) {
+    index_lines(source);
+  }
+
+  unsigned int offset = loc - source->base;
+  int lo = 0;
+  int hi = source->n_lines - 1;
+
+  // last line starting at or before offset
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+
+    if (source->lines[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  *line = lo + 1;
+  *col = offset - source->lines[lo] + 1;
+}
@@ -0,0 +1,39 @@
+#ifndef SOURCE_HEADER
+#define SOURCE_HEADER
+
+#include <stdio.h>
+
+// contents of an input file held in memory
+// files are mapped, streams like stdin are read into a buffer
+struct Source {
+  char *name;
+  const char *buf;
+  long len;
+  int mapped; // buf came from mmap rather than malloc
+
+  // location of buf[0]
+  // every source gets its own range of locations
+  unsigned int base;
+
+  // offsets of the start of each line
+  // only built when a location in this source has to be printed
+  unsigned int *lines;
+  int n_lines;
+};
+
+// a source location is a 32-bit offset into the sources laid end to end
+#define NO_LOC 0xffffffffu
+
+struct Source *map_source(char *path);
+struct Source *read_source(FILE *stream, char *name);
+void close_source(struct Source *source);
+
+// text made up during preprocessing, like pasted tokens, gets locations in
+// scratch sources so it can be lexed and printed like any other text
+unsigned int scratch_text(const char *text, int len);
+
+struct Source *loc_source(unsigned int loc);
+const char *loc_ptr(unsigned int loc);
+void loc_line_col(unsigned int loc, int *line, int *col);
+
+#endif
@@ -1,15 +1,21 @@
 // type for type checking
 // contains builtin types and user defined types (typedefs, enums, unions,
 // structs)
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "fail.h"
+#include "intern.h"
+#include "lexer.h"
 #include "symbols.h"
 #include "types.h"
 
-struct Func *cur_func = NULL;
+// everything about the scopes being parsed is thread local, so function
+// bodies can be parsed in parallel over the file scope tables, see parse
+_Thread_local struct Func *cur_func = NULL;
 
 // TODO: handle partial definitions
 char *symbol_repr[] = {
@@ -17,352 +23,497 @@ char *symbol_repr[] = {
     [S_PARAM] = "param",     [S_ENUM_CONST] = "enum const", [S_FUNC] = "func"};
 
 // parent table type
+// one entry per name, holding the stack of definitions that shadow each other
+// file scope entries are chained newest first so they can be walked in order
+// locals have entries of their own in a table per thread, which are looked
+// at before the file scope ones
 struct Table {
   struct Table *next;
-  char *name;
+  unsigned int name;
   struct Def {
     struct Def *next;
+    int depth; // scope depth it was defined at, 0 for file scope
+    int pos;   // token position it was defined at, see visible_pos
   } *def;
 };
 
 struct SymbolTable {
   struct SymbolTable *next;
-  char *name;
+  unsigned int name;
   struct SymDef {
     struct SymDef *next;
+    int depth;
+    int pos;
     struct Symbol *sym;
   } *def;
 } *symbol_table;
 
 struct StructTable {
   struct StructTable *next;
-  char *name;
+  unsigned int name;
   struct StDef {
     struct StDef *next;
+    int depth;
+    int pos;
     struct Struct *struc;
   } *def;
 } *struct_table;
 
-struct Scope {
-  struct Scope *next;
-  struct Table *table;
+// open addressing hash index from name to table entry
+// entries never move so scopes can point at them
+struct Index {
+  struct Table **slots;
+  unsigned int cap; // power of two
+  unsigned int count;
 };
 
-struct Scope *struct_scope = NULL;
-struct Scope *symbol_scope = NULL;
+struct Index symbol_index;
+struct Index struct_index;
 
-void new_scope() {
-  struct Scope *new_symbol_scope = malloc(sizeof(*new_symbol_scope));
-  *new_symbol_scope = (struct Scope){.table = NULL, .next = symbol_scope};
-  symbol_scope = new_symbol_scope;
+_Thread_local struct Index local_symbol_index;
+_Thread_local struct Index local_struct_index;
 
-  struct Scope *new_struct_scope = malloc(sizeof(*new_struct_scope));
-  *new_struct_scope = (struct Scope){.table = NULL, .next = struct_scope};
-  struct_scope = new_struct_scope;
-}
+// file scope definitions made after this token position are ignored
+// a body parsed out of order only sees what was defined before it
+_Thread_local int visible_pos = INT_MAX;
+
+unsigned int hash_name(unsigned int name) { return name * 2654435761u; }
+
+// find slot for name, empty if it is not in the index
+struct Table **index_slot(struct Index *index, unsigned int name) {
+  unsigned int mask = index->cap - 1;
+  unsigned int i = hash_name(name) & mask;
 
-void add_to_scope(struct Scope **scope, struct Table *table) {
-  struct Scope *new = malloc(sizeof(*scope));
+  while (index->slots[i] && index->slots[i]->name != name) {
+    i = (i + 1) & mask;
+  }
 
-  new->table = table;
-  new->next = *scope;
-  *scope = new;
+  return &index->slots[i];
 }
 
-// pop all definitions from this last scope
-// free scope and def structs
-void free_scope(struct Scope **the_scope) {
-  struct Scope *scope = *the_scope;
-  while (1) {
-    if (scope->table == NULL) {
-      struct Scope *old = scope;
-      *the_scope = scope->next;
-      free(old);
-      break;
+void index_insert(struct Index *index, struct Table *table) {
+  // keep load factor under a half
+  if (2 * (index->count + 1) > index->cap) {
+    struct Index old = *index;
+
+    index->cap = old.cap ? 2 * old.cap : 64;
+    index->slots = calloc(index->cap, sizeof(*index->slots));
+
+    for (unsigned int i = 0; i < old.cap; i++) {
+      if (old.slots[i]) {
+        *index_slot(index, old.slots[i]->name) = old.slots[i];
+      }
     }
 
-    struct Table *table = scope->table;
-    struct Def *old_d = table->def;
+    free(old.slots);
+  }
 
-    table->def = table->def->next;
+  *index_slot(index, table->name) = table;
+  index->count++;
+}
 
-    free(old_d);
+// scopes are an undo log of the entries that got a new def, and a stack of
+// marks into the log where each scope starts
+// exiting a scope pops one def from each entry logged after its mark
+struct Log {
+  struct Table **tables;
+  int len, cap;
+};
 
-    struct Scope *old = scope;
-    scope = scope->next;
-    free(old);
-  }
+_Thread_local struct Log symbol_log;
+_Thread_local struct Log struct_log;
+
+_Thread_local struct Mark {
+  int symbols, structs;
+} *scope_marks;
+
+_Thread_local int scope_depth = 0; // 0 at file scope
+_Thread_local int scope_marks_cap = 0;
+
+// entries, defs and symbols of locals only live as long as their scope
+// everything in it is freed at once when the outermost scope exits
+_Thread_local struct Arena scope_arena;
+
+// region for the defs and symbols of the current scope
+struct Arena *def_arena() { return scope_depth ? &scope_arena : &global_arena; }
+
+// allocate zeroed data that outlives the current scope
+// data made inside a function body goes with the body
+void *lasting_alloc(long size) {
+  return arena_calloc(scope_depth ? &ast_arena : &global_arena, size);
 }
 
-void free_symbol_scope() {
-  struct Scope *scope = symbol_scope;
+// copy data into the same region as lasting_alloc, NULL if size is 0
+void *lasting_copy(void *data, long size) {
+  return arena_copy(scope_depth ? &ast_arena : &global_arena, data, size);
+}
 
-  while (1) {
-    if (scope->table == NULL) {
-      struct Scope *old = scope;
-      symbol_scope = scope->next;
-      free(old);
-      break;
-    }
+// forget every local entry once no scope is open
+void clear_locals() {
+  struct Index *indexes[] = {&local_symbol_index, &local_struct_index};
 
-    struct Table *table = scope->table;
-    struct SymDef *old_d = (void *)table->def;
-    table->def = table->def->next;
+  for (int i = 0; i < 2; i++) {
+    if (indexes[i]->count) {
+      memset(indexes[i]->slots, 0, indexes[i]->cap * sizeof(struct Table *));
+      indexes[i]->count = 0;
+    }
+  }
 
-    // TODO could free symbol data if it is unused
-    // could use refcounting
-    free(old_d->sym);
-    free(old_d);
+  arena_reset(&scope_arena);
+}
 
-    struct Scope *old = scope;
-    scope = scope->next;
-    free(old);
+void new_scope() {
+  if (scope_depth == scope_marks_cap) {
+    scope_marks_cap = scope_marks_cap ? 2 * scope_marks_cap : 16;
+    scope_marks =
+        realloc(scope_marks, scope_marks_cap * sizeof(*scope_marks));
   }
+
+  scope_marks[scope_depth++] =
+      (struct Mark){.symbols = symbol_log.len, .structs = struct_log.len};
 }
 
-void free_struct_scope() { free_scope(&struct_scope); }
+void add_to_scope(struct Log *log, struct Table *table) {
+  if (log->len == log->cap) {
+    log->cap = log->cap ? 2 * log->cap : 64;
+    log->tables = realloc(log->tables, log->cap * sizeof(*log->tables));
+  }
+
+  log->tables[log->len++] = table;
+}
 
 // exit a scope
+// pop all definitions from this last scope
 void exit_scope() {
-  if (symbol_scope == NULL) {
-    printf("Compiler error\n");
+  if (scope_depth == 0) {
+    error_printf("Compiler error\n");
     FAIL;
   }
 
-  free_symbol_scope();
-  free_struct_scope();
-}
+  struct Mark mark = scope_marks[--scope_depth];
 
-// finds if name is in current scope
-struct Def *find_in_scope(char *name, struct Scope *scope) {
-  if (scope == NULL) {
-    return NULL;
+  while (symbol_log.len > mark.symbols) {
+    struct Table *table = symbol_log.tables[--symbol_log.len];
+    table->def = table->def->next;
   }
 
-  while (scope->table != NULL) {
-    if (!strcmp(name, scope->table->name)) {
-      return scope->table->def;
-    }
+  while (struct_log.len > mark.structs) {
+    struct Table *table = struct_log.tables[--struct_log.len];
+    table->def = table->def->next;
+  }
 
-    scope = scope->next;
+  if (scope_depth == 0) {
+    clear_locals();
+  }
+}
+
+// finds if name is defined in current scope
+// file scope is never searched
+struct Def *find_in_scope(struct Table *table) {
+  if (scope_depth && table->def && table->def->depth == scope_depth) {
+    return table->def;
   }
 
   return NULL;
 }
 
 // find entry for identifier in table
-struct Table *find_in_table(char *name, struct Table *table) {
-  while (table != NULL) {
-    if (!strcmp(name, table->name)) {
-      return table;
-    }
+struct Table *find_in_table(unsigned int name, struct Index *index) {
+  if (index->cap == 0) {
+    return NULL;
+  }
+
+  return *index_slot(index, name);
+}
 
-    table = table->next;
+// make a new entry for a name that is not in the table
+// local entries are not chained in a list
+struct Table *new_in_table(unsigned int name, struct Table **list,
+                           struct Index *index, size_t size) {
+  struct Table *table = arena_alloc(def_arena(), size);
+  table->name = name;
+  table->def = NULL;
+
+  if (list) {
+    table->next = *list;
+    *list = table;
   }
 
-  return NULL;
+  index_insert(index, table);
+  return table;
+}
+
+// newest file scope def that was made before visible_pos
+struct Def *visible_def(struct Table *table) {
+  struct Def *def = table ? table->def : NULL;
+
+  while (def && def->pos > visible_pos) {
+    def = def->next;
+  }
+
+  return def;
 }
 
 // lookup symbol in symbol table
-struct Symbol *lookup_symbol(char *name) {
-  struct SymbolTable *table = (void *)find_in_table(name, (void *)symbol_table);
+struct Symbol *lookup_symbol(unsigned int name) {
+  struct SymbolTable *table;
 
-  if (table && table->def)
-    return table->def->sym;
+  if (scope_depth) {
+    table = (void *)find_in_table(name, &local_symbol_index);
 
-  return NULL;
+    if (table && table->def)
+      return table->def->sym;
+  }
+
+  table = (void *)find_in_table(name, &symbol_index);
+  struct SymDef *def = (void *)visible_def((void *)table);
+
+  return def ? def->sym : NULL;
 }
 
 // lookup struct in struct table
-struct Struct *lookup_struct(char *name) {
-  struct StructTable *table = (void *)find_in_table(name, (void *)struct_table);
+struct Struct *lookup_struct(unsigned int name) {
+  struct StructTable *table;
 
-  if (table && table->def)
-    return table->def->struc;
+  if (scope_depth) {
+    table = (void *)find_in_table(name, &local_struct_index);
 
-  return NULL;
+    if (table && table->def)
+      return table->def->struc;
+  }
+
+  table = (void *)find_in_table(name, &struct_index);
+  struct StDef *def = (void *)visible_def((void *)table);
+
+  return def ? def->struc : NULL;
+}
+
+// find entry for name in symbol table of the current scope, adding one if
+// there is none
+struct SymbolTable *symbol_entry(unsigned int name) {
+  struct Index *index = scope_depth ? &local_symbol_index : &symbol_index;
+  struct SymbolTable *table = (void *)find_in_table(name, index);
+
+  if (table == NULL) {
+    table = (void *)new_in_table(
+        name, scope_depth ? NULL : (void *)&symbol_table, index,
+        sizeof(*table));
+  }
+
+  return table;
+}
+
+// find entry for name in struct table of the current scope, adding one if
+// there is none
+struct StructTable *struct_entry(unsigned int name) {
+  struct Index *index = scope_depth ? &local_struct_index : &struct_index;
+  struct StructTable *table = (void *)find_in_table(name, index);
+
+  if (table == NULL) {
+    table = (void *)new_in_table(
+        name, scope_depth ? NULL : (void *)&struct_table, index,
+        sizeof(*table));
+  }
+
+  return table;
 }
 
 // define a new symbol
 // use other functions for defining functions/globals
 // always returns pointer to new symbol
-struct Symbol *add_symbol(char *name) {
-  if (symbol_scope) {
-    if (find_in_scope(name, symbol_scope)) {
-      printf("Semantic error: redefining %s in same scope\n", name);
-      FAIL;
-    }
-  } else {
-    struct SymbolTable *table =
-        (void *)find_in_table(name, (void *)symbol_table);
+struct Symbol *add_symbol(unsigned int name) {
+  struct SymbolTable *table = symbol_entry(name);
 
-    if (table && table->def) {
-      printf("Semantic error: redefining %s\n", name);
+  if (scope_depth) {
+    if (find_in_scope((void *)table)) {
+      error_printf("Semantic error: redefining %s in same scope\n",
+                   intern_str(name));
       FAIL;
     }
+  } else if (table->def) {
+    error_printf("Semantic error: redefining %s\n", intern_str(name));
+    FAIL;
   }
 
-  struct SymDef *def = calloc(1, sizeof(*def));
-
-  struct SymbolTable *table = (void *)find_in_table(name, (void *)symbol_table);
-
-  if (table) {
-    def->next = table->def;
-    table->def = def;
-  } else {
-    def->next = NULL;
-    table = malloc(sizeof(*table));
-    table->name = malloc(strlen(name) + 1);
-    strcpy(table->name, name);
-    table->def = def;
-    table->next = symbol_table;
-    symbol_table = table;
-  }
+  struct SymDef *def = arena_calloc(def_arena(), sizeof(*def));
+  def->next = table->def;
+  def->depth = scope_depth;
+  def->pos = save_tokens();
+  table->def = def;
 
-  if (symbol_scope)
-    add_to_scope(&symbol_scope, (void *)table);
+  if (scope_depth)
+    add_to_scope(&symbol_log, (void *)table);
 
-  def->sym = calloc(1, sizeof(*def->sym));
+  def->sym = arena_calloc(def_arena(), sizeof(*def->sym));
 
   return def->sym;
 }
 
 // define global
 // can return pointer to incomplete definition
-struct Global *add_global(char *name) {
+struct Global *add_global(unsigned int name) {
   // globals can only be defined outside of scope
-  if (symbol_scope)
+  if (scope_depth)
     FAIL;
 
-  struct SymbolTable *table = (void *)find_in_table(name, (void *)symbol_table);
+  struct SymbolTable *table = symbol_entry(name);
 
-  if (table) {
-    if (table->def) {
-      if (table->def->sym->kind == S_GLOBAL) {
-        return table->def->sym->global;
-      } else {
-        printf("Semantic error: redefining symbol %s as global\n", name);
-        FAIL;
-      }
+  if (table->def) {
+    if (table->def->sym->kind == S_GLOBAL) {
+      return table->def->sym->global;
+    } else {
+      error_printf("Semantic error: redefining symbol %s as global\n",
+                   intern_str(name));
+      FAIL;
     }
-  } else {
-    table = malloc(sizeof(*table));
-    table->name = malloc(strlen(name) + 1);
-    strcpy(table->name, name);
-    table->next = symbol_table;
-    symbol_table = table;
   }
 
-  struct SymDef *def = calloc(1, sizeof(*def));
+  struct SymDef *def = arena_calloc(def_arena(), sizeof(*def));
   def->next = table->def;
+  def->pos = save_tokens();
   table->def = def;
 
-  def->sym = calloc(1, sizeof(*def->sym));
+  def->sym = arena_calloc(def_arena(), sizeof(*def->sym));
   def->sym->kind = S_GLOBAL;
-  def->sym->global = calloc(1, sizeof(*def->sym->global));
-  def->sym->global->name = malloc(strlen(name) + 1);
-  strcpy(def->sym->global->name, name);
+  def->sym->global = lasting_alloc(sizeof(*def->sym->global));
+  def->sym->global->name = name;
 
   return def->sym->global;
 }
 
+// locals of the function being parsed
+_Thread_local struct Var **locals = NULL;
+_Thread_local int n_locals = 0;
+_Thread_local int locals_cap = 0;
+
 // add a local variable
-struct Var *add_local(char *name, struct Type *type) {
+struct Var *add_local(unsigned int name, struct Type *type) {
   struct Symbol *sym = add_symbol(name);
   sym->kind = S_VAR;
-  sym->var = malloc(sizeof(*sym->var));
-  sym->var->name = malloc(strlen(name));
-  strcpy(sym->var->name, name);
+  sym->var = lasting_alloc(sizeof(*sym->var));
+  sym->var->name = name;
   sym->var->type = type;
+
+  if (n_locals == locals_cap) {
+    locals_cap = locals_cap ? 2 * locals_cap : 16;
+    locals = realloc(locals, locals_cap * sizeof(*locals));
+  }
+
+  locals[n_locals++] = sym->var;
+
   return sym->var;
 }
 
+void freeze_locals(struct Func *func) {
+  func->vars = lasting_copy(locals, n_locals * sizeof(*func->vars));
+  func->n_vars = n_locals;
+  n_locals = 0;
+}
+
+void drop_scopes() {
+  scope_depth = 0;
+  symbol_log.len = 0;
+  struct_log.len = 0;
+  n_locals = 0;
+  clear_locals();
+}
+
+void free_scopes() {
+  free(symbol_log.tables);
+  free(struct_log.tables);
+  free(scope_marks);
+  free(locals);
+  free(local_symbol_index.slots);
+  free(local_struct_index.slots);
+  arena_free(&scope_arena);
+}
+
 // define a new struct
 // can return pointer to incomplete definition
-struct Struct *add_struct(char *name) {
+struct Struct *add_struct(unsigned int name) {
   // previous definition if it exists
   // if it is in an outer scope we shadow instead of completing
-  struct StDef *prev_def = (void *)find_in_scope(name, struct_scope);
+  struct StructTable *table = struct_entry(name);
+  struct StDef *prev_def = (void *)find_in_scope((void *)table);
 
   if (prev_def)
     return prev_def->struc;
 
-  struct StDef *def = malloc(sizeof(*def));
-  def->struc = calloc(1, sizeof(*def->struc));
-  def->struc->name = malloc(strlen(name) + 1);
-  strcpy(def->struc->name, name);
-
-  struct StructTable *table = (void *)find_in_table(name, (void *)struct_table);
-
-  if (table) {
-    def->next = table->def;
-    table->def = def;
-    if (struct_scope)
-      add_to_scope(&struct_scope, (void *)table);
-  } else {
-    def->next = NULL;
-
-    table = malloc(sizeof(*table));
-    table->name = malloc(strlen(name) + 1);
-    strcpy(table->name, name);
-    table->def = def;
-    table->next = struct_table;
-    struct_table = table;
-    if (struct_scope)
-      add_to_scope(&struct_scope, (void *)table);
-  }
+  struct StDef *def = arena_calloc(def_arena(), sizeof(*def));
+  def->struc = lasting_alloc(sizeof(*def->struc));
+  def->struc->name = name;
+
+  def->next = table->def;
+  def->depth = scope_depth;
+  def->pos = save_tokens();
+  table->def = def;
+
+  if (scope_depth)
+    add_to_scope(&struct_log, (void *)table);
 
   return def->struc;
 }
 
 // define a new function
 // can return pointer to incomplete definition
-struct Func *add_func(char *name) {
+struct Func *add_func(unsigned int name) {
   // functions can only be defined outside of scope
-  if (symbol_scope)
+  if (scope_depth)
     FAIL;
 
-  struct SymbolTable *table = (void *)find_in_table(name, (void *)symbol_table);
+  struct SymbolTable *table = symbol_entry(name);
 
-  if (table) {
-    if (table->def && table->def->sym->kind == S_FUNC) {
+  if (table->def) {
+    if (table->def->sym->kind == S_FUNC) {
       return table->def->sym->func;
     } else {
-      printf("Semantic error: redefining symbol %s as function\n", name);
+      error_printf("Semantic error: redefining symbol %s as function\n",
+                   intern_str(name));
       FAIL;
     }
   }
 
-  if (table) {
-    if (table->def) {
-      if (table->def->sym->kind == S_FUNC) {
-        return table->def->sym->func;
-      } else {
-        printf("Semantic error: redefining symbol %s as global\n", name);
-        FAIL;
-      }
-    }
-  } else {
-    table = malloc(sizeof(*table));
-    table->name = malloc(strlen(name) + 1);
-    strcpy(table->name, name);
-    table->next = symbol_table;
-    symbol_table = table;
-  }
-
-  struct SymDef *def = calloc(1, sizeof(*def));
+  struct SymDef *def = arena_calloc(def_arena(), sizeof(*def));
   def->next = table->def;
+  def->pos = save_tokens();
   table->def = def;
 
-  def->sym = calloc(1, sizeof(*def->sym));
+  def->sym = arena_calloc(def_arena(), sizeof(*def->sym));
   def->sym->kind = S_FUNC;
-  def->sym->func = calloc(1, sizeof(*def->sym->func));
-  def->sym->func->name = malloc(strlen(name) + 1);
-  strcpy(def->sym->func->name, name);
+  def->sym->func = lasting_alloc(sizeof(*def->sym->func));
+  def->sym->func->name = name;
 
   return def->sym->func;
 }
 
+// add a struct that was built somewhere else, at file scope
+void define_struct(unsigned int name, struct Struct *struc) {
+  struct StDef *def = arena_calloc(def_arena(), sizeof(*def));
+  def->struc = struc;
+
+  struct StructTable *table = struct_entry(name);
+
+  def->next = table->def;
+  def->depth = 0;
+  table->def = def;
+}
+
+void visit_globals(void (*visit_symbol)(unsigned int name, struct Symbol *sym),
+                   void (*visit_struct)(unsigned int name,
+                                        struct Struct *struc)) {
+  for (struct SymbolTable *table = symbol_table; table; table = table->next) {
+    if (table->def) {
+      visit_symbol(table->name, table->def->sym);
+    }
+  }
+
+  for (struct StructTable *table = struct_table; table; table = table->next) {
+    if (table->def) {
+      visit_struct(table->name, table->def->struc);
+    }
+  }
+}
+
 void debug_symbol(struct Symbol *symbol) {
   if (symbol == NULL) {
     printf("NULL\n");
@@ -389,16 +540,12 @@ void debug_symbol(struct Symbol *symbol) {
   case S_FUNC:
     printf("Function: (");
 
-    struct Param *param = symbol->func->sig->params;
-
-    while (param != NULL) {
-      debug_type(param->type);
-
-      param = param->next;
-
-      if (param) {
+    for (int i = 0; i < symbol->func->sig->n_params; i++) {
+      if (i) {
         printf(", ");
       }
+
+      debug_type(symbol->func->sig->params[i].type);
     }
 
     printf(") -> ");
@@ -413,6 +560,8 @@ void debug_symbol(struct Symbol *symbol) {
 
 void debug_symbols() {
   // walk through and print symbols associated with identifiers
+  // entries are listed newest first, in the order their names were first
+  // defined at file scope, locals and parameters never make entries here
   printf("Symbols are:\n");
 
   struct SymbolTable *sym_entry = symbol_table;
@@ -421,7 +570,7 @@ void debug_symbols() {
     struct SymDef *def = sym_entry->def;
 
     while (def) {
-      printf("- %s\n  ", sym_entry->name);
+      printf("- %s\n  ", intern_str(sym_entry->name));
 
       debug_symbol(sym_entry->def->sym);
       def = def->next;
@@ -438,21 +587,19 @@ void debug_symbols() {
     struct StDef *def = st_entry->def;
 
     while (def) {
-      printf("- %s\n", st_entry->name);
+      printf("- %s\n", intern_str(st_entry->name));
 
-      struct Field *field = (st_entry->def->struc)->fields;
+      struct Struct *struc = st_entry->def->struc;
 
-      while (field != NULL) {
+      for (int i = 0; i < struc->n_fields; i++) {
         printf("    ");
-        debug_type(field->type);
+        debug_type(struc->fields[i].type);
 
-        if (field->name != NULL) {
-          printf(" %s\n", field->name);
+        if (struc->fields[i].name) {
+          printf(" %s\n", intern_str(struc->fields[i].name));
         } else {
           printf(" anon\n");
         }
-
-        field = field->next;
       }
 
       def = def->next;
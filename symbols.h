@@ -1,8 +1,10 @@
 #ifndef SYMBOLS_HEADER
 #define SYMBOLS_HEADER
 
+// names are interned ids from intern.h
+
 struct Var {
-  char *name;
+  unsigned int name;
   struct Type *type;
   // TODO function stack position information
   // some variables might not need to be put on stack
@@ -10,7 +12,7 @@ struct Var {
 };
 
 struct Global {
-  char *name;
+  unsigned int name;
   struct Type *type;
   int complete;
   // initialization value
@@ -18,42 +20,65 @@ struct Global {
 };
 
 struct Enum {
-  char *name;
+  unsigned int name;
 };
 
 // same layout as Struct
 struct Union {
-  char *name; // NULL for anonymous union
+  unsigned int name; // 0 for anonymous union
   struct Field *fields;
+  int n_fields;
   int complete;
-  // size, alignment
+  int laid_out;
+  int laying_out;
+  int align;
+  long size;
+  struct Member *members;
+  int members_cap;
 };
 
 // same layout as Union
 struct Struct {
-  char *name; // NULL for anonymous struct
-  struct Field *fields;
+  unsigned int name; // 0 for anonymous struct
+  struct Field *fields; // array of n_fields
+  int n_fields;
   int complete;
-  // size, alignment
+  // layout is worked out the first time it is needed, see types.h
+  int laid_out;
+  int laying_out; // set while its fields are laid out
+  int align;
+  long size;
+  // members by name, built on the first member access
+  // open addressing, members_cap is a power of two
+  struct Member *members;
+  int members_cap;
 };
 
 // type and name of field in union or struct
 struct Field {
-  char *name;
-  struct Field *next;
+  unsigned int name; // 0 for anonymous struct or union member
+  struct Type *type;
+  long offset; // in bytes from the start of the struct, set by the layout
+};
+
+// a member that can be named in a member access
+// members of anonymous struct or union members are flattened in
+struct Member {
+  unsigned int name; // 0 for an empty slot
   struct Type *type;
+  long offset; // in bytes from the start of the outer struct
 };
 
 // signature of a function
 struct FuncSig {
   struct Type *ret;
-  struct Param *params;
+  struct Param *params; // array of n_params
+  int n_params;
 };
 
 struct Param {
-  char *name;
+  unsigned int name; // 0 for unnamed parameter
   struct Type *type;
-  struct Param *next;
 };
 
 // anything that can be represented by an identifier
@@ -74,34 +99,66 @@ struct Symbol {
 extern char *symbol_repr[];
 
 struct Func {
-  char *name;
+  unsigned int name;
   struct FuncSig *sig;
   struct BlockStmt *stmt;
   int complete;
-  struct VarList *vars;
-};
-
-struct VarList {
-  struct Var *var;
-  struct VarList *next;
+  // every local in the body, including parameters
+  struct Var **vars;
+  int n_vars;
+  // a body that was skipped is parsed from body_pos with the named params
+  // body_pos is 0 once it has been parsed or is about to be
+  int body_pos;
+  struct Param *params;
+  int n_params;
 };
 
-extern struct Func *cur_func;
+extern _Thread_local struct Func *cur_func;
 
+// scopes and locals are per thread, file scope symbols are shared
 void new_scope();
 void exit_scope();
 
+// leave every scope at once, after an error jumped out of them
+void drop_scopes();
+
+// free the scope buffers of a thread that is done parsing
+void free_scopes();
+
+// file scope symbols defined after this token position can't be looked up
+// set while parsing a function body out of order so it sees what it would
+// have seen parsed in place, INT_MAX otherwise
+extern _Thread_local int visible_pos;
+
 void debug_type(struct Type *type);
 void debug_symbol(struct Symbol *symbol);
 void debug_symbols();
 
-struct Symbol *add_symbol(char *name);
-struct Struct *add_struct(char *name);
-struct Func *add_func(char *name);
-struct Global *add_global(char *name);
-struct Var *add_local(char *name, struct Type *type);
+struct Symbol *add_symbol(unsigned int name);
+struct Struct *add_struct(unsigned int name);
+struct Func *add_func(unsigned int name);
+struct Global *add_global(unsigned int name);
+struct Var *add_local(unsigned int name, struct Type *type);
+
+// give func the locals added since the last call
+// must be called before leaving the function's outermost scope
+void freeze_locals(struct Func *func);
+
+// allocate zeroed memory that lives as long as what is being parsed
+// file scope data lasts the whole compile, data made in a function body lasts
+// as long as the body
+void *lasting_alloc(long size);
+
+// copy size bytes of data into the same region, NULL if size is 0
+void *lasting_copy(void *data, long size);
+
+struct Symbol *lookup_symbol(unsigned int name);
+struct Struct *lookup_struct(unsigned int name);
 
-struct Symbol *lookup_symbol(char *name);
-struct Struct *lookup_struct(char *name);
+// used for precompiled headers, see pch.c
+void define_struct(unsigned int name, struct Struct *struc);
+void visit_globals(void (*visit_symbol)(unsigned int name, struct Symbol *sym),
+                   void (*visit_struct)(unsigned int name,
+                                        struct Struct *struc));
 
 #endif
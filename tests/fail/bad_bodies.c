@@ -0,0 +1,6 @@
+// several bodies have errors, only the first one in the file is reported
+// whichever worker finds it
+int f() { return 1 }
+int g() { return 2 }
+int h() { return undefined_name; }
+int main() { return 0; }
@@ -0,0 +1,5 @@
+// the error in g comes before the missing ; after the typedef, which the
+// skim finds first, so it is the one reported
+int g() { return 1 + ; }
+typedef int T
+int main() { return 0; }
@@ -0,0 +1,4 @@
+// an empty character constant is a syntax error
+#if '' == 0
+#endif
+int main() { return 0; }
@@ -0,0 +1,4 @@
+// \x needs at least one hex digit
+#if '\x' == 0
+#endif
+int main() { return 0; }
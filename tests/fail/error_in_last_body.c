@@ -0,0 +1,10 @@
+// earlier bodies parse fine, the error is in the last one
+struct s {
+  int a;
+};
+int f(struct s *p) { return p->a; }
+int g(struct s *p) { return p->a + f(p); }
+int main() {
+  struct s v;
+  return v.missing;
+}
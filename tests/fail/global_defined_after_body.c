@@ -0,0 +1,4 @@
+// a body parsed out of order must not see a global defined after it
+int f() { return counter; }
+int counter;
+int main() { return f(); }
@@ -0,0 +1,2 @@
+// flags: --dump-tokens
+#include "no_such_header.h"
@@ -0,0 +1,3 @@
+// flags: --dump-tokens
+// the header name runs into the end of the file, which has no newline
+#include <x
\ No newline at end of file
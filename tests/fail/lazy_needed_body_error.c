@@ -0,0 +1,4 @@
+// flags: --lazy-bodies
+// a body that main uses is parsed, so its error is reported
+int broken() { return 1 + ; }
+int main() { return broken(); }
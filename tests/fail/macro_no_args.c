@@ -0,0 +1,5 @@
+// flags: --dump-tokens
+// a macro with a parameter called with nothing between the parentheses is
+// called with one empty argument, but one with two parameters needs a comma
+#define add(a, b) ((a) + (b))
+int x = add();
@@ -0,0 +1,4 @@
+// flags: --dump-tokens
+// a macro with two parameters called with one argument
+#define add(a, b) ((a) + (b))
+int x = add(1);
@@ -0,0 +1,4 @@
+// flags: --dump-tokens
+// a macro with two parameters called with three arguments
+#define add(a, b) ((a) + (b))
+int x = add(1, 2, 3);
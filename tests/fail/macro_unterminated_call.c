@@ -0,0 +1,4 @@
+// flags: --dump-tokens
+// the arguments of a macro call run into the end of the file
+#define add(a, b) ((a) + (b))
+int x = add(1, (2);
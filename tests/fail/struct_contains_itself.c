@@ -0,0 +1,7 @@
+// a struct can't contain itself by value, this used to recurse in the layout
+// until the stack overflowed
+struct a {
+  int y;
+  struct a x;
+};
+int main() { return sizeof(struct a); }
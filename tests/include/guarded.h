@@ -0,0 +1,5 @@
+// the whole file is inside the guard, so it is only read once
+#ifndef GUARDED_H
+#define GUARDED_H
+guarded;
+#endif
@@ -0,0 +1,4 @@
+#ifndef SYSTEM_H
+#define SYSTEM_H
+from_include_path;
+#endif
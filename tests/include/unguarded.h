@@ -0,0 +1,6 @@
+#ifndef UNGUARDED_H
+#define UNGUARDED_H
+unguarded_once;
+#endif
+// outside the #ifndef, so this file isn't guarded and is read every time
+unguarded_every_time;
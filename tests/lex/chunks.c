@@ -0,0 +1,45 @@
+// lexed whole and in many numbers of chunks, which have to give the same
+// tokens, chunks split at newlines so every line below starts a chunk for
+// some count
+/* a block comment
+   int not_a_token = 1;
+   "not a string
+   // not a line comment
+   'not a char
+*/
+int after_comment;
+char *s1 = "a string with /* what looks like a comment";
+char *s2 = "and */ the end of one";
+char *s3 = "// and a line comment";
+char c1 = '"';
+char c2 = '\'';
+char c3 = '/';
+/* a comment
+with "a quote in it
+on several lines */ int after_quote;
+// a line comment with /* an unclosed block comment
+int after_line_comment;
+/*
+*/ /* */ /**/ /***/ /* * / */
+int a1 = 1 >>= 2 <<= 3 ... -> ++ -- && || ## # %= ^= |= &= != == <= >=;
+int a2 = 0x1f + 017 + 1e+5 + 1.5e-3 + .5 + 1. + 10u + 10ul;
+int a3 = a1>>=a2<<=a1->a2;
+char *s4 = "a string \
+continued";
+// a line comment continued \
+onto the next line
+int after_continued_comment;
+/* several
+lines
+of
+comment
+/* with an opening inside
+// and a line comment inside
+*/
+int after_long_comment;
+char *s5 = "\"escaped quotes\" and \\ backslashes \\";
+char *s6 = "/*" "*/" "//";
+/* a comment that ends the line */
+int mixed /* in */ = /* the */ 1 /* middle */;
+// the last line has tokens
+int last = 1;
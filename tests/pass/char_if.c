@@ -0,0 +1,18 @@
+// character constants in #if have their C values, escapes included
+#if 'a' == 97 && '\n' == 10 && '\x41' == 65 && '\0' == 0
+int plain;
+#else
+#error plain character constants
+#endif
+
+#if '\'' == 39 && '\\' == 92 && '\101' == 65 && '"' == 34
+int escaped;
+#else
+#error escaped character constants
+#endif
+
+#if 'a' == 39
+#error character constant evaluated to its closing quote
+#endif
+
+int main() { return 0; }
@@ -0,0 +1,11 @@
+// flags: --dump-tokens -Itests/include
+#include "../include/guarded.h"
+#include "../include/guarded.h"
+#include "../include/unguarded.h"
+#include "../include/unguarded.h"
+// undefining the guard lets the file be included again
+#undef GUARDED_H
+#include "../include/guarded.h"
+#include <system.h>
+#include <system.h>
+end;
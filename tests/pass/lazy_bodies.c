@@ -0,0 +1,9 @@
+// flags: --lazy-bodies
+// only main's body and the bodies it uses are parsed, in whatever order they
+// are needed
+int twice(int n);
+int base;
+int add(int a, int b) { return a + b + base; }
+int twice(int n) { return add(n, n); }
+int unused(int n) { return twice(n) * 3; }
+int main() { return twice(2); }
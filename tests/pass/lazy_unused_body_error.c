@@ -0,0 +1,5 @@
+// flags: --lazy-bodies
+// a body that nothing needs is only brace matched, so the error in it is
+// never reported
+int broken() { return 1 + ; }
+int main() { return 0; }
@@ -0,0 +1,43 @@
+// flags: --dump-tokens
+// macro expansion, mostly examples from the C standard
+
+// a macro isn't expanded again inside its own expansion
+#define x (4 + y)
+#define y (2 * x)
+x;
+y;
+#define z z[0]
+z;
+#define foo(a) bar a
+foo(foo) (2);
+
+// nested function-like calls, f(2) expands to a call of g with the (9)
+// after it
+#define f(a) a * g
+#define g(a) f(a)
+f(2)(9);
+#define h(a) (a + 1)
+h(h(h(1)));
+#define m(a) a(w)
+#define w 0, 1
+m(m);
+
+// an empty argument, and a call with no arguments
+#define one(a) [a]
+#define none() nothing
+one() none();
+
+// stringize and paste
+#define str(s) #s
+#define xstr(s) str(s)
+#define cat(a, b) a##b
+#define xcat(a, b) cat(a, b)
+#define VERSION 3
+int cat(glo, bal);
+int xcat(v, VERSION);
+int cat(v, VERSION);
+char *s = str(a + "b\n" '\'' x);
+char *t = xstr(VERSION);
+char *u = str(VERSION);
+char *v = xstr(int cat(a, b));
+cat(+, =) cat(<<, =) cat(, right) cat(left, );
@@ -0,0 +1,37 @@
+// bodies parsed by different workers see the file scope as it was where
+// they are, and share struct layouts and types
+struct point {
+  int x;
+  int y;
+};
+int scale;
+int dot(struct point *a, struct point *b) {
+  return a->x * b->x + a->y * b->y * scale;
+}
+struct box {
+  struct point lo;
+  struct point hi;
+};
+int area(struct box *b) {
+  struct point d;
+  d.x = b->hi.x - b->lo.x;
+  d.y = b->hi.y - b->lo.y;
+  return d.x * d.y;
+}
+int x;
+int shadow(int y) {
+  int x;
+  x = y;
+  return x + sizeof(struct box);
+}
+int later(int n) {
+  struct point { char c; } p;
+  p.c = n;
+  return p.c + scale + x;
+}
+int main() {
+  struct box b;
+  b.lo.x = 0;
+  b.hi.x = 2;
+  return area(&b) + dot(&b.lo, &b.hi) + shadow(1) + later(2);
+}
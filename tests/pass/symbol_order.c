@@ -0,0 +1,14 @@
+// the symbol dump lists file scope names newest first, in the order they
+// were first defined, whatever locals or parameters used the names earlier
+int proto(int x, int second);
+int first(int later, int y) {
+  struct tag { int a; } t;
+  int second;
+  return later + y;
+}
+int later;
+struct tag { char c; };
+int x(int);
+int second;
+struct other { int b; };
+int main() { return 0; }
@@ -0,0 +1,21 @@
+// precompiled by tests/run.sh, covers macros, a nested include, structs that
+// point at each other, typedefs and function types
+#ifndef HEADER_H
+#define HEADER_H
+#include "sub.h"
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define NAME "header"
+#define C(a, b) a##b
+#define S(x) #x
+typedef int (*handler)(int, char *);
+struct node {
+  struct node *next;
+  struct sub s;
+  char name[16];
+};
+typedef struct node node_t;
+int compare(node_t *a, node_t *b);
+void (*signal(int, void (*fp)(int)))(int);
+int counter;
+struct { int anon; } anon_global;
+#endif
@@ -0,0 +1,2 @@
+#define SUB_VALUE 7
+struct sub { int v; };
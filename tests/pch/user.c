@@ -0,0 +1,10 @@
+#include "header.h"
+#include "header.h"
+node_t head;
+handler h;
+int compare(node_t *a, node_t *b);
+int use() { return MAX(1, SUB_VALUE) + head.s.v + anon_global.anon; }
+int main() { return use() + head.next->name[0]; }
+int C(new, var);
+char *p = NAME;
+char *q = S(a "b" c);
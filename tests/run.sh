@@ -0,0 +1,124 @@
+#!/bin/sh
+# run the compiler over the tests, from the top of the tree
+#
+# files in tests/pass must compile and files in tests/fail must be rejected
+# with exit status 1 rather than a crash, and if a test has a .out file next
+# to it the output has to match it
+# every test is compiled with -j1, with -j4 and with its sources lexed in 7
+# chunks, and has to print the same every way, so parsing bodies and lexing
+# chunks in parallel find the same first error as doing it in order
+# a line "// flags: ..." in a test adds those options to both runs
+#
+# the tokens of tests/lex/*.c have to be the same lexed whole and in any
+# number of chunks
+#
+# tests/pch/header.h is precompiled and tests/pch/user.c has to compile the
+# same with and without it, and a header that changed after it was
+# precompiled or a file that isn't a precompiled header for this build has
+# to be rejected
+
+compiler=./compiler
+out=build/test
+failed=0
+
+fail() {
+  echo "FAIL: $*"
+  failed=1
+}
+
+# check <file> <exit status>
+check() {
+  flags=$(sed -n 's|^// flags: ||p' "$1")
+
+  $compiler -j1 $flags "$1" > $out.j1
+  status=$?
+  $compiler -j4 $flags "$1" > $out.j4
+
+  if [ $? -ne $status ]; then
+    fail "$1 exits differently with -j4"
+  elif ! cmp -s $out.j1 $out.j4; then
+    fail "$1 prints differently with -j4"
+  fi
+
+  $compiler -j1 --lex-chunks 7 $flags "$1" > $out.chunks
+
+  if [ $? -ne $status ]; then
+    fail "$1 exits differently lexed in chunks"
+  elif ! cmp -s $out.j1 $out.chunks; then
+    fail "$1 prints differently lexed in chunks"
+  fi
+
+  if [ $status -ne "$2" ]; then
+    fail "$1 exited with $status"
+  elif [ -f "${1%.c}.out" ] && ! cmp -s $out.j1 "${1%.c}.out"; then
+    fail "$1 output differs from ${1%.c}.out"
+  fi
+}
+
+for f in tests/pass/*.c; do
+  check "$f" 0
+done
+
+for f in tests/fail/*.c; do
+  check "$f" 1
+done
+
+# chunks start at newlines, so between them these counts put a chunk
+# boundary on most lines of a small file
+for f in tests/lex/*.c; do
+  $compiler --dump-tokens --lex-chunks 1 "$f" > $out.whole
+
+  for n in 2 3 4 5 7 8 11 13 16 23 32 47 64; do
+    $compiler --dump-tokens --lex-chunks $n "$f" > $out.chunks
+
+    if ! cmp -s $out.whole $out.chunks; then
+      fail "$f gives different tokens lexed in $n chunks"
+    fi
+  done
+done
+
+# check_rejected <pch> <source> <expected message>
+check_rejected() {
+  $compiler --use-pch "$1" "$2" > $out.txt
+
+  if [ $? -ne 2 ] || ! grep -q "$3" $out.txt; then
+    fail "$1 was not rejected as $3"
+  fi
+}
+
+$compiler tests/pch/user.c > $out.plain
+
+if ! $compiler --emit-pch $out.pch tests/pch/header.h > /dev/null; then
+  fail "couldn't precompile tests/pch/header.h"
+elif ! $compiler --use-pch $out.pch tests/pch/user.c > $out.txt; then
+  fail "tests/pch/user.c didn't compile with tests/pch/header.h precompiled"
+elif ! cmp -s $out.plain $out.txt; then
+  fail "tests/pch/user.c prints differently with its header precompiled"
+fi
+
+# a header that is changed after it is precompiled
+echo 'int before;' > $out.h
+printf '#include "test.h"\nint main() { return before; }\n' > $out.c
+$compiler --emit-pch $out.stale.pch $out.h > /dev/null
+
+if ! $compiler --use-pch $out.stale.pch $out.c > /dev/null; then
+  fail "$out.c didn't compile with $out.h precompiled"
+fi
+
+echo 'int added;' >> $out.h
+check_rejected $out.stale.pch $out.c "out of date"
+
+echo 'not a precompiled header' > $out.bad.pch
+check_rejected $out.bad.pch tests/pch/user.c "not a precompiled header"
+
+# the right magic but a record size from some other build, the sizes start
+# right after the 8 bytes of magic
+cp $out.pch $out.bad.pch
+printf '\377' | dd of=$out.bad.pch bs=1 seek=8 conv=notrunc 2> /dev/null
+check_rejected $out.bad.pch tests/pch/user.c "not a precompiled header"
+
+if [ $failed -eq 0 ]; then
+  echo "all tests passed"
+fi
+
+exit $failed
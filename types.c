@@ -1,8 +1,11 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "fail.h"
+#include "intern.h"
 #include "symbols.h"
 #include "types.h"
 
@@ -11,112 +14,475 @@ char *type_repr[] = {
     "array", "enum", "struct", "union", "function",
 };
 
-// returns 1 if two types are equivalent
-int compare_func_sig(struct FuncSig *sig1, struct FuncSig *sig2) {
-    if (!type_eq(sig1->ret, sig2->ret)) {
-      return 0;
-    }
+// canonical types and parameter lists are hash consed into these tables
+// open addressing, power of two capacity, nodes live in global_arena
+struct ConsTable {
+  void **slots;
+  unsigned int cap;
+  unsigned int count;
+};
 
-    struct Param *param1 = sig1->params;
-    struct Param *param2 = sig2->params;
+struct ConsTable type_table;
 
-    while (param1 != NULL && param2 != NULL) {
-      if (!type_eq(param1->type, param2->type)) {
-        return 0;
-      }
+// function bodies parsed in parallel share the type table and the layouts
+// and member tables cached on structs, they are only changed under this lock
+// a thread can take it again while it holds it
+pthread_mutex_t type_lock = PTHREAD_MUTEX_INITIALIZER;
+_Thread_local int type_lock_depth = 0;
+
+void lock_types() {
+  if (type_lock_depth++ == 0) {
+    pthread_mutex_lock(&type_lock);
+  }
+}
+
+void unlock_types() {
+  if (--type_lock_depth == 0) {
+    pthread_mutex_unlock(&type_lock);
+  }
+}
+
+// structs whose layout this thread has started but not finished, innermost
+// last, only the thread holding the lock has any
+_Thread_local struct Struct **open_layouts;
+_Thread_local int n_open_layouts = 0;
+_Thread_local int open_layouts_cap = 0;
+
+void release_types() {
+  // an error in the middle of a layout leaves it to be started again
+  while (n_open_layouts) {
+    open_layouts[--n_open_layouts]->laying_out = 0;
+  }
 
-      param1 = param1->next;
-      param2 = param2->next;
+  if (type_lock_depth) {
+    type_lock_depth = 0;
+    pthread_mutex_unlock(&type_lock);
+  }
+}
+
+void free_type_buffers() {
+  free(open_layouts);
+  open_layouts = NULL;
+  open_layouts_cap = 0;
+}
+
+unsigned long hash_ptr(unsigned long h, void *p) {
+  return (h ^ (unsigned long)p) * 0x9e3779b97f4a7c15ul;
+}
+
+unsigned long hash_type(struct Type *type) {
+  unsigned long h = hash_ptr(0, (void *)(unsigned long)type->kind);
+
+  switch (type->kind) {
+  case T_POINTER:
+    return hash_ptr(h, type->ptr_type);
+  case T_ARRAY:
+    h = hash_ptr(h, type->array.elem_type);
+    return hash_ptr(h, (void *)(long)type->array.len);
+  case T_ENUM:
+  case T_STRUCT:
+  case T_UNION:
+    return hash_ptr(h, type->struct_type);
+  case T_FUNC:
+    h = hash_ptr(h, type->func_sig->ret);
+
+    for (int i = 0; i < type->func_sig->n_params; i++) {
+      h = hash_ptr(h, type->func_sig->params[i].type);
     }
 
-    // check that both are null
-    return param1 == param2;
+    return h;
+  default:
+    return h;
+  }
 }
 
-// returns 1 if two types are equivalent
-int type_eq(struct Type *l, struct Type *r) {
+// compare types whose parts are canonical
+int same_type(struct Type *l, struct Type *r) {
   if (l->kind != r->kind) {
     return 0;
-  };
+  }
 
   switch (l->kind) {
-  case T_INT:
-  case T_CHAR:
-  case T_FLOAT:
-  case T_VOID:
-    // builtins match if the enum is the same
-    return 1;
-
+  case T_POINTER:
+    return l->ptr_type == r->ptr_type;
   case T_ARRAY:
-    if (l->array.len != r->array.len) {
+    return l->array.elem_type == r->array.elem_type &&
+           l->array.len == r->array.len;
+  case T_ENUM:
+  case T_STRUCT:
+  case T_UNION:
+    return l->struct_type == r->struct_type;
+  case T_FUNC:
+    if (l->func_sig->ret != r->func_sig->ret ||
+        l->func_sig->n_params != r->func_sig->n_params) {
       return 0;
     }
-    // fallthrough
+
+    for (int i = 0; i < l->func_sig->n_params; i++) {
+      if (l->func_sig->params[i].type != r->func_sig->params[i].type) {
+        return 0;
+      }
+    }
+
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+// find slot holding a node equal to key, or the empty slot it would go in
+void **cons_slot(struct ConsTable *table, void *key, unsigned long hash,
+                 int (*same)()) {
+  unsigned int mask = table->cap - 1;
+  unsigned int i = hash & mask;
+
+  while (table->slots[i] && !same(table->slots[i], key)) {
+    i = (i + 1) & mask;
+  }
+
+  return &table->slots[i];
+}
+
+// return the node equal to key, making a copy of key if there is none
+void *hash_cons(struct ConsTable *table, void *key, long size,
+                unsigned long (*hash)(), int (*same)()) {
+  // keep load factor under a half
+  if (2 * (table->count + 1) > table->cap) {
+    struct ConsTable old = *table;
+
+    table->cap = old.cap ? 2 * old.cap : 256;
+    table->slots = calloc(table->cap, sizeof(*table->slots));
+
+    for (unsigned int i = 0; i < old.cap; i++) {
+      if (old.slots[i]) {
+        void *node = old.slots[i];
+        *cons_slot(table, node, hash(node), same) = node;
+      }
+    }
+
+    free(old.slots);
+  }
+
+  void **slot = cons_slot(table, key, hash(key), same);
+
+  if (*slot == NULL) {
+    *slot = memcpy(arena_alloc(&global_arena, size), key, size);
+    table->count++;
+  }
+
+  return *slot;
+}
+
+// function types are looked up with their parameters in a buffer on the
+// stack, which is only copied out if the type is new
+// parameter names are dropped
+struct Type *cons_type(struct Type *type);
+
+struct Type *canon_func(struct FuncSig *from) {
+  // one extra so it is never empty
+  struct Param params[from->n_params + 1];
+  struct FuncSig sig = {cons_type(from->ret), params, from->n_params};
+
+  for (int i = 0; i < from->n_params; i++) {
+    params[i] = (struct Param){0, cons_type(from->params[i].type)};
+  }
+
+  struct Type key = {.kind = T_FUNC, .func_sig = &sig};
+  struct Type *node =
+      hash_cons(&type_table, &key, sizeof(key), hash_type, same_type);
+
+  if (node->func_sig == &sig) {
+    node->func_sig = arena_copy(&global_arena, &sig, sizeof(sig));
+    node->func_sig->params =
+        arena_copy(&global_arena, params, sig.n_params * sizeof(*params));
+  }
+
+  return node;
+}
+
+// canon_type with the lock held
+struct Type *cons_type(struct Type *type) {
+  struct Type key = *type;
+
+  switch (type->kind) {
   case T_POINTER:
-    return type_eq(l->ptr_type, r->ptr_type);
+    key.ptr_type = cons_type(type->ptr_type);
+    break;
+  case T_ARRAY:
+    key.array.elem_type = cons_type(type->array.elem_type);
+    break;
+  case T_FUNC:
+    return canon_func(type->func_sig);
+  default:
+    break;
+  }
 
-  case T_STRUCT:
-  case T_UNION:
+  return hash_cons(&type_table, &key, sizeof(key), hash_type, same_type);
+}
+
+struct Type *canon_type(struct Type *type) {
+  lock_types();
+  struct Type *node = cons_type(type);
+  unlock_types();
+
+  return node;
+}
+
+// size of unknown types is an error
+void unsized_type(struct Type *type) {
+  error_printf("Semantic error: size of type '");
+  debug_type(type);
+  error_printf("' is unknown\n");
+  FAIL;
+}
+
+long type_size(struct Type *type) {
+  switch (type->kind) {
+  case T_CHAR:
+    return 1;
+  case T_INT:
+  case T_FLOAT:
   case T_ENUM:
-    // should point to same definition
-    return l->struct_type == r->struct_type;
+    return 4;
+  case T_POINTER:
+    return 8;
+  case T_ARRAY:
+    if (type->array.len < 0) {
+      break;
+    }
 
+    return type->array.len * type_size(type->array.elem_type);
+  case T_STRUCT:
+  case T_UNION:
+    return struct_layout(type)->size;
+  case T_VOID:
   case T_FUNC:
-    return compare_func_sig(l->func_sig, r->func_sig);
+    break;
   }
 
-  FAIL;
+  unsized_type(type);
   return 0;
 }
 
-void debug_type(struct Type *type) {
+int type_align(struct Type *type) {
   switch (type->kind) {
-  case T_FUNC:
-    printf("fn (");
-    struct Param *param = type->func_sig->params;
+  case T_ARRAY:
+    return type_align(type->array.elem_type);
+  case T_STRUCT:
+  case T_UNION:
+    return struct_layout(type)->align;
+  default:
+    // scalars are aligned to their size
+    return type_size(type);
+  }
+}
+
+struct Struct *struct_layout(struct Type *type) {
+  struct Struct *struc = type->struct_type;
+
+  // the flag is only set once the layout is all written
+  if (__atomic_load_n(&struc->laid_out, __ATOMIC_ACQUIRE)) {
+    return struc;
+  }
+
+  lock_types();
+
+  if (struc->laid_out) {
+    unlock_types();
+    return struc;
+  }
+
+  if (!struc->complete) {
+    error_printf("Semantic error: incomplete type '");
+    debug_type(type);
+    error_printf("'\n");
+    FAIL;
+  }
+
+  // a field needs the layout of its type, so this is reached again if the
+  // struct contains itself by value
+  if (struc->laying_out) {
+    error_printf("Semantic error: '");
+    debug_type(type);
+    error_printf("' contains itself\n");
+    FAIL;
+  }
+
+  if (n_open_layouts == open_layouts_cap) {
+    open_layouts_cap = open_layouts_cap ? 2 * open_layouts_cap : 8;
+    open_layouts =
+        realloc(open_layouts, open_layouts_cap * sizeof(*open_layouts));
+  }
+
+  open_layouts[n_open_layouts++] = struc;
+  struc->laying_out = 1;
+
+  long size = 0;
+  int align = 1;
+
+  // an anonymous member is laid out like any other member, and the offsets
+  // of its fields are from the start of the member
+  for (int i = 0; i < struc->n_fields; i++) {
+    struct Field *field = &struc->fields[i];
+
+    long field_size = type_size(field->type);
+    int field_align = type_align(field->type);
+
+    if (type->kind == T_UNION) {
+      field->offset = 0;
+      size = field_size > size ? field_size : size;
+    } else {
+      field->offset = (size + field_align - 1) / field_align * field_align;
+      size = field->offset + field_size;
+    }
+
+    if (field_align > align) {
+      align = field_align;
+    }
+  }
+
+  // padded so every element of an array is aligned
+  struc->size = (size + align - 1) / align * align;
+  struc->align = align;
+  struc->laying_out = 0;
+  n_open_layouts--;
+  __atomic_store_n(&struc->laid_out, 1, __ATOMIC_RELEASE);
+
+  unlock_types();
+  return struc;
+}
+
+int count_members(struct Struct *struc) {
+  int n = 0;
+
+  for (int i = 0; i < struc->n_fields; i++) {
+    struct Field *field = &struc->fields[i];
+
+    n += field->name ? 1 : count_members(field->type->struct_type);
+  }
+
+  return n;
+}
+
+// add members of struc to a table of cap slots
+void add_members(struct Member *members, int cap, struct Struct *struc,
+                 long offset) {
+  unsigned int mask = cap - 1;
+
+  for (int i = 0; i < struc->n_fields; i++) {
+    struct Field *field = &struc->fields[i];
+
+    if (field->name == 0) {
+      // anonymous struct or union
+      add_members(members, cap, field->type->struct_type,
+                  offset + field->offset);
+      continue;
+    }
+
+    unsigned int slot = field->name * 2654435761u & mask;
+
+    while (members[slot].name) {
+      if (members[slot].name == field->name) {
+        error_printf("Semantic error: duplicate member %s\n",
+                     intern_str(field->name));
+        FAIL;
+      }
+
+      slot = (slot + 1) & mask;
+    }
 
-    while (param != NULL) {
-      debug_type(param->type);
+    members[slot] = (struct Member){field->name, field->type,
+                                    offset + field->offset};
+  }
+}
+
+struct Member *struct_member(struct Type *type, unsigned int name) {
+  struct Struct *struc = struct_layout(type);
+  struct Member *members = __atomic_load_n(&struc->members, __ATOMIC_ACQUIRE);
+
+  if (members == NULL) {
+    lock_types();
+    members = struc->members;
+
+    if (members == NULL) {
+      // keep load factor under a half
+      int n = count_members(struc);
+      int cap = 2;
+
+      while (cap < 2 * n) {
+        cap *= 2;
+      }
+
+      members = arena_calloc(&global_arena, cap * sizeof(struct Member));
+      add_members(members, cap, struc, 0);
+
+      // published once it is filled in
+      struc->members_cap = cap;
+      __atomic_store_n(&struc->members, members, __ATOMIC_RELEASE);
+    }
+
+    unlock_types();
+  }
+
+  unsigned int mask = struc->members_cap - 1;
+  unsigned int i = name * 2654435761u & mask;
+
+  while (members[i].name) {
+    if (members[i].name == name) {
+      return &members[i];
+    }
+
+    i = (i + 1) & mask;
+  }
 
-      param = param->next;
+  return NULL;
+}
+
+void debug_type(struct Type *type) {
+  switch (type->kind) {
+  case T_FUNC:
+    error_printf("fn (");
 
-      if (param) {
-        printf(", ");
+    for (int i = 0; i < type->func_sig->n_params; i++) {
+      if (i) {
+        error_printf(", ");
       }
+
+      debug_type(type->func_sig->params[i].type);
     }
 
-    printf(") -> ");
+    error_printf(") -> ");
     debug_type(type->func_sig->ret);
     break;
   case T_ENUM:
   case T_STRUCT:
   case T_UNION:
-    printf("%s ", type_repr[type->kind]);
+    error_printf("%s ", type_repr[type->kind]);
     if (type->struct_type->name)
-      printf("%s", type->struct_type->name);
+      error_printf("%s", intern_str(type->struct_type->name));
     else
-      printf("anon");
+      error_printf("anon");
     break;
   case T_POINTER:
-    printf("(");
+    error_printf("(");
     debug_type(type->ptr_type);
-    printf(")*");
+    error_printf(")*");
     break;
   case T_ARRAY:
-    printf("(");
+    error_printf("(");
     debug_type(type->array.elem_type);
 
-    printf(")[");
+    error_printf(")[");
 
     if (type->array.len != -1) {
-      printf("%d", type->array.len);
+      error_printf("%d", type->array.len);
     }
 
-    printf("]");
+    error_printf("]");
 
     break;
   default:
-    printf("%s", type_repr[type->kind]);
+    error_printf("%s", type_repr[type->kind]);
   }
 }
 
@@ -133,15 +499,11 @@ struct Type *type_sound(struct Type *type) {
 
     switch (cur->kind) {
     case T_STRUCT:
-    case T_UNION:;
-      struct Field *field = cur->struct_type->fields;
-
-      while (field != NULL) {
-        struct Type *t = type_sound(field->type);
+    case T_UNION:
+      for (int i = 0; i < cur->struct_type->n_fields; i++) {
+        struct Type *t = type_sound(cur->struct_type->fields[i].type);
         if (t)
           return t;
-
-        field = field->next;
       }
 
       return NULL;
@@ -155,6 +517,12 @@ struct Type *type_sound(struct Type *type) {
       return NULL;
 
     case T_POINTER:
+      // structs can point to themselves, and only need to be checked where
+      // they are used by value
+      if (cur->ptr_type->kind == T_STRUCT || cur->ptr_type->kind == T_UNION) {
+        return NULL;
+      }
+
       cur = cur->ptr_type;
 
       break;
@@ -176,20 +544,18 @@ struct Type *type_sound(struct Type *type) {
 
     case T_FUNC:;
       // check parameters and return type
-      struct Param *param = cur->func_sig->params;
+      for (int i = 0; i < cur->func_sig->n_params; i++) {
+        struct Type *param = cur->func_sig->params[i].type;
 
-      while (param != NULL) {
-        if (param->type->kind == T_ARRAY) {
-          struct Type *t = type_sound(param->type->array.elem_type);
+        if (param->kind == T_ARRAY) {
+          struct Type *t = type_sound(param->array.elem_type);
           if (t)
             return t;
         } else {
-          struct Type *t = type_sound(param->type);
+          struct Type *t = type_sound(param);
           if (t)
             return t;
         }
-
-        param = param->next;
       }
 
       // function can't return array or function
@@ -213,79 +579,30 @@ void type_verify(struct Type *type) {
   struct Type *t = type_sound(type);
 
   if (t) {
-    printf("Semantic error: illegal type '");
+    error_printf("Semantic error: illegal type '");
     debug_type(t);
 
     if (t != type) {
-      printf("' in type definition '");
+      error_printf("' in type definition '");
       debug_type(type);
     }
 
-    printf("'\n");
+    error_printf("'\n");
 
     if (t->kind == T_FUNC) {
       if (t->func_sig->ret->kind == T_FUNC) {
-        printf("Cannot define function returning a function\n");
+        error_printf("Cannot define function returning a function\n");
       } else if (t->func_sig->ret->kind == T_ARRAY) {
-        printf("Cannot define function returning an array\n");
+        error_printf("Cannot define function returning an array\n");
       }
     } else if (t->kind == T_ARRAY) {
       if (t->array.elem_type->kind == T_FUNC) {
-        printf("Cannot define array of functions\n");
+        error_printf("Cannot define array of functions\n");
       } else if (t->array.len == -1) {
-        printf("Unsized array\n");
+        error_printf("Unsized array\n");
       }
     }
 
     FAIL;
   }
 }
-
-void free_func_sig(struct FuncSig *sig) {
-  free_type(sig->ret);
-
-  struct Param *param = sig->params;
-
-  while (param != NULL) {
-    struct Param *new = param->next;
-    free(param->name);
-    free_type(param->type);
-    free(param);
-    param = new;
-  }
-
-  free(sig);
-}
-
-void free_type(struct Type *type) {
-  if (type->istypedef) {
-    return;
-  }
-
-  while (type != NULL) {
-    struct Type *old = type;
-
-    switch (type->kind) {
-    case T_POINTER:
-    case T_ARRAY:
-      type = type->ptr_type;
-      free(old);
-      break;
-    case T_FUNC:
-      free_func_sig(type->func_sig);
-      free(old);
-      return;
-      break;
-    case T_CHAR:
-    case T_FLOAT:
-    case T_VOID:
-    case T_INT:
-    case T_ENUM:
-    case T_UNION:
-    case T_STRUCT:
-      free(old);
-      return;
-      break;
-    }
-  }
-}
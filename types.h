@@ -16,10 +16,6 @@ struct Type {
     T_FUNC
   } kind;
 
-  // if this is a typedef we don't want to free it
-  // TODO: could use this for rc instead of leaking memory
-  int istypedef;
-
   union {
     struct Type *ptr_type;
     struct {
@@ -36,18 +32,35 @@ struct Type {
 
 extern char *type_repr[];
 
-int type_eq(struct Type *l, struct Type *r);
+// canonical copy of a type
+// types are hash consed so equal types are always the same node, and can be
+// compared with ==
+// canonical function types have no parameter names
+struct Type *canon_type(struct Type *type);
 
-void debug_type(struct Type *type);
+// size and alignment in bytes, following the SysV x86-64 ABI
+// fails on types that have no size, like void or an incomplete struct
+// struct and union layouts are worked out once and cached on the struct
+long type_size(struct Type *type);
+int type_align(struct Type *type);
 
-struct Type *type_sound(struct Type *type);
+// struct or union of type, with size, alignment and field offsets set
+struct Struct *struct_layout(struct Type *type);
 
-void type_verify(struct Type *type);
+// member of a struct or union by name, NULL if there is none
+struct Member *struct_member(struct Type *type, unsigned int name);
 
-void free_func_sig(struct FuncSig *sig);
+// the functions above are safe to call from threads parsing function bodies
+// release_types gives up the lock they share if an error jumped out of one
+void release_types();
 
-void free_type(struct Type *type);
+// free the buffers of a thread that is done with types
+void free_type_buffers();
 
-int compare_func_sig(struct FuncSig *sig1, struct FuncSig *sig2);
+void debug_type(struct Type *type);
+
+struct Type *type_sound(struct Type *type);
+
+void type_verify(struct Type *type);
 
 #endif